@@ -0,0 +1,136 @@
+/*-
+ * Round-trip quality and throughput benchmark for the voice codecs, run on
+ * synthetic blocks so no sound device is needed.
+ * 
+ * usage: codec_bench [blocks]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "core_audio.h++"
+#include "voice_codec.t++"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace vanwestco;
+using Block_t = Audio_Handle::Block_t;
+
+/* same as max_payload_length and header_length in ../packet.h++ */
+static constexpr const std::size_t payload_limit = 1024;
+static constexpr const std::size_t packet_header = 8;
+
+/**
+ * Fills blocks with something vaguely voice-shaped: a wobbling fundamental
+ * with falling harmonics, a syllable-rate envelope and a little noise.
+ */
+static std::vector<Block_t> make_blocks(int count) {
+    std::vector<Block_t> blocks;
+    std::mt19937 noise_source(1);
+    std::normal_distribution<double> noise(0, 200);
+    const double rate = Audio_Handle::sample_rate;
+    
+    long t = 0;
+    double phase = 0;
+    for (int b = 0; b < count; ++b) {
+        blocks.emplace_back();
+        for (auto& sample : blocks.back().channel()) {
+            double seconds = t++ / rate;
+            double pitch = 140 + 30 * std::sin(2 * M_PI * 0.7 * seconds);
+            double envelope = 0.55 + 0.45 * std::sin(2 * M_PI * 4 * seconds);
+            double value = 0;
+            phase += 2 * M_PI * pitch / rate;
+            for (int h = 1; h <= 8; ++h) {
+                value += std::sin(phase * h) / h;
+            }
+            value = 6000 * envelope * value + noise(noise_source);
+            sample = static_cast<std::int16_t>(
+                    std::max(-32768.0, std::min(32767.0, value)));
+        }
+    }
+    return blocks;
+}
+
+/**
+ * Encodes and decodes every block with codec C and reports the results.
+ */
+template <typename C>
+static void run(const char* name, std::vector<Block_t>& blocks) {
+    Voice_Encoder<C, Block_t> encoder(payload_limit);
+    std::vector<std::vector<char>> frames;
+    std::size_t frame_bytes = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (const Block_t& block : blocks) {
+        encoder.encode(block, [&](std::size_t bytes) {
+            frames.emplace_back(bytes);
+            frame_bytes += bytes;
+            return frames.back().data();
+        });
+    }
+    auto encoded = std::chrono::steady_clock::now();
+    
+    Block_t out;
+    Voice_Frame header;
+    double signal = 0, error = 0;
+    std::size_t next = 0;
+    for (const Block_t& block : blocks) {
+        for (std::size_t f = 0; f < encoder.frames_per_block(); ++f) {
+            const std::vector<char>& frame = frames[next++];
+            if (!Voice_Decoder<Block_t>::decode(frame.data(), frame.size(),
+                                                header, out)) {
+                std::cerr << name << ": frame failed to decode" << std::endl;
+                std::exit(1);
+            }
+        }
+        for (std::size_t i = 0; i < Block_t::frames; ++i) {
+            double original = block.channel()[i];
+            double difference = original - out.channel()[i];
+            signal += original * original;
+            error += difference * difference;
+        }
+    }
+    auto decoded = std::chrono::steady_clock::now();
+    
+    double audio_seconds = static_cast<double>(blocks.size()) * Block_t::frames
+                         / Audio_Handle::sample_rate;
+    double encode_time = std::chrono::duration<double>(encoded - start).count();
+    double decode_time = std::chrono::duration<double>(decoded
+                                                       - encoded).count();
+    double wire_bytes = frame_bytes
+                      + frames.size() * static_cast<double>(packet_header);
+    double raw_bytes = blocks.size()
+                     * (Block_t::frames * sizeof(std::int16_t)
+                        + static_cast<double>(packet_header));
+    
+    std::cout << std::left << std::setw(22) << name << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(6) << encoder.frames_per_block() << " frames"
+              << std::setw(8) << wire_bytes * 8 / audio_seconds / 1000
+              << " kbit/s"
+              << std::setw(6) << raw_bytes / wire_bytes << "x"
+              << std::setw(7) << 10 * std::log10(signal / error) << " dB"
+              << std::setw(9) << audio_seconds / encode_time << "x enc"
+              << std::setw(9) << audio_seconds / decode_time << "x dec"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 2000;
+    std::vector<Block_t> blocks = make_blocks(count);
+    
+    std::cout << count << " blocks of " << Block_t::frames << " samples; "
+              << "speeds are multiples of real time" << std::endl;
+    run<PCM_Codec>("raw PCM", blocks);
+    run<IMA_ADPCM_Codec<1>>("IMA-ADPCM", blocks);
+    run<IMA_ADPCM_Codec<2>>("IMA-ADPCM, half rate", blocks);
+    
+    return 0;
+}
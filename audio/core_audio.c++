@@ -1,9 +1,5 @@
 #include "core_audio.h++"
 
-/* annoyingly need to do this */
-template<int S, typename B>
-vanwestco::Audio_Handle::Audio_Stream<S, B>::~Audio_Stream() { }
-
 #ifdef USE_PORTAUDIO_FOR_SOUND
 
 #include "portaudio_stream.t++"
@@ -15,6 +15,16 @@
 #include <exception>
 #include <stdexcept>
 #include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * Frames per audio block. Smaller blocks mean less capture latency and more
+ * packets; build with e.g. -D AUDIO_FRAMES_PER_BUFFER=960 to change it.
+ */
+#ifndef AUDIO_FRAMES_PER_BUFFER
+#define AUDIO_FRAMES_PER_BUFFER 480
+#endif
 
 namespace vanwestco {
 
@@ -66,11 +76,15 @@ public:
 /**
  * Template for a variable-channel-count block of audio.
  * 
+ * The channels live on the heap so blocks move cheaply. Blocks made by an
+ * Audio_Block_Pool hand their channels back to the pool when destroyed
+ * instead of freeing them.
+ * 
  * @tparam S the sample type
  * @tparam C the channel count
  * @tparam F the per-channel frames
  * 
- * @version 5
+ * @version 6
  */
 template <typename S, int C, std::size_t F>
 class Audio_Block {
@@ -81,16 +95,44 @@ public:
     static constexpr const int channel_count = C;
     static constexpr const std::size_t frames = F;
     using Channel_t = std::array<Sample_t, frames>;
+    using Storage_t = std::array<Channel_t, channel_count>;
+    
+    /**
+     * Somewhere for a block's channels to go when it's done with them.
+     */
+    class Recycler {
+    public:
+        virtual void recycle(Storage_t* storage) = 0;
+    protected:
+        ~Recycler() = default;
+    };
     
     /**
      * Constructs an audio block with the correct-size array of channels.
      */
-    Audio_Block() : channels(new std::array<Channel_t, channel_count>) { }
+    Audio_Block() : channels(new Storage_t, Storage_Deleter { nullptr }) { }
+    
+    /**
+     * Constructs an audio block around existing channels, which go to owner
+     * when the block is destroyed.
+     * 
+     * @param storage the channels
+     * @param owner where they go afterwards
+     */
+    Audio_Block(Storage_t* storage, Recycler* owner)
+    : channels(storage, Storage_Deleter { owner }) { }
     
     Audio_Block(Audio_Block&) = delete;
     Audio_Block(Audio_Block&& old) = default;
+    Audio_Block& operator=(Audio_Block&& old) = default;
     ~Audio_Block() = default;
     
+    /**
+     * @return whether the block has channels (it won't after being moved
+     *         from)
+     */
+    explicit operator bool() const { return channels != nullptr; }
+    
     /**
      * Gets a channel by its index, if possible; defaults to the channel at
      * index 0 (useful for mono data).
@@ -99,20 +141,107 @@ public:
      * @return the channel
      */
     constexpr inline Channel_t& channel(int index = 0) {
-        if (index < 0 || index > C) {
+        if (index < 0 || index >= C) {
             throw std::out_of_range("index out of bounds");
         }
         return (*channels)[index];
     }
     
     constexpr inline const Channel_t& channel(int index = 0) const {
-        return channel(index);
+        if (index < 0 || index >= C) {
+            throw std::out_of_range("index out of bounds");
+        }
+        return (*channels)[index];
     }
 private:
+    struct Storage_Deleter {
+        Recycler* owner;
+        
+        void operator()(Storage_t* storage) const {
+            if (owner != nullptr) {
+                owner->recycle(storage);
+            } else {
+                delete storage;
+            }
+        }
+    };
+    
     /**
      * Stores the channels in a moveable housing.
      */
-    std::unique_ptr<std::array<Channel_t, channel_count>> channels;
+    std::unique_ptr<Storage_t, Storage_Deleter> channels;
+};
+
+/*----------------------------------------------------------------------------*
+ |                             Audio_Block_Pool                               |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Preallocated channel storage for Audio_Blocks, so making a block in the
+ * audio path doesn't mean a trip to the allocator. Blocks can be made and
+ * destroyed from any thread. The pool must outlive its blocks.
+ * 
+ * @tparam B the block type
+ * 
+ * @version 0
+ */
+template <typename B>
+class Audio_Block_Pool : public B::Recycler {
+public:
+    using Block_t = B;
+    using Storage_t = typename B::Storage_t;
+    
+    /**
+     * @param preallocate how many blocks' worth of storage to start with
+     */
+    Audio_Block_Pool(std::size_t preallocate = 16) {
+        spare.reserve(preallocate);
+        for (std::size_t i = 0; i < preallocate; ++i) {
+            spare.push_back(new Storage_t);
+        }
+    }
+    
+    Audio_Block_Pool(Audio_Block_Pool&) = delete;
+    
+    ~Audio_Block_Pool() {
+        for (Storage_t* storage : spare) { delete storage; }
+    }
+    
+    /**
+     * Makes a block out of pooled storage (growing the pool if it's empty).
+     * The samples are left as they were.
+     * 
+     * @return the block
+     */
+    Block_t acquire() {
+        Storage_t* storage = nullptr; {
+            std::lock_guard l(lock);
+            if (!spare.empty()) {
+                storage = spare.back();
+                spare.pop_back();
+            }
+        }
+        if (storage == nullptr) { storage = new Storage_t; }
+        return Block_t(storage, this);
+    }
+    
+    void recycle(Storage_t* storage) override {
+        std::lock_guard l(lock);
+        spare.push_back(storage);
+    }
+    
+    /**
+     * The pool shared by everything using blocks of type B.
+     * 
+     * @return the pool
+     */
+    static Audio_Block_Pool& shared() {
+        static Audio_Block_Pool pool;
+        return pool;
+    }
+private:
+    std::mutex lock;
+    std::vector<Storage_t*> spare;
 };
 
 /*----------------------------------------------------------------------------*
@@ -145,9 +274,10 @@ public:
     constexpr const static int channel_count = 1;
     
     /**
-     * Sets the number of frames per buffer.
+     * Sets the number of frames per buffer (see AUDIO_FRAMES_PER_BUFFER).
      */
-    constexpr const static std::size_t frames_per_buffer = 4096;
+    constexpr const static std::size_t frames_per_buffer
+            = AUDIO_FRAMES_PER_BUFFER;
     
     /**
      * Holds the size of each sample.
@@ -213,13 +343,21 @@ public:
     /**
      * Constructs an audio handle. Behavior is only defined when one handle
      * exists at a time, which is probably not good but fine for now.
-     * TODO: add the option to change the number of frames per buffer.
      * 
      * @throws Audio_Exception if something happens during PortAudio startup
      * @throws Audio_Use_Exception if something happens during stream opening
      */
     Audio_Handle();
     
+    /**
+     * Constructs an audio handle around a stream of the caller's choosing,
+     * e.g. a Synthetic_Stream for running without a sound device.
+     * 
+     * @param s the stream
+     */
+    Audio_Handle(std::unique_ptr<Audio_Stream<sample_rate, Block_t>> s)
+    : stream(std::move(s)) { }
+    
     /**
      * Destroys the audio handle. As with the constructor, behavior is only
      * defined with one handle in existence.
@@ -249,6 +387,11 @@ private:
     std::unique_ptr<Audio_Stream<sample_rate, Block_t>> stream;
 };
 
+/* annoyingly need to do this (and it has to be visible wherever a stream is
+   made, so it lives here) */
+template<int S, typename B>
+inline Audio_Handle::Audio_Stream<S, B>::~Audio_Stream() { }
+
 } /* ~namespace vanwestco */
 
 #endif /* ~BASILIO_CHAT_CORE_AUDIO_HXX */
@@ -0,0 +1,242 @@
+/*-
+ * Headless playout benchmark: Synthetic_Stream microphone -> Voice_Encoder ->
+ * a simulated network (random delay, loss and reordering) -> Jitter_Buffer ->
+ * Synthetic_Stream speaker, at a few frame sizes. Then several speakers at
+ * once, joining a second apart, through one shared Jitter_Buffer and through
+ * a Voice_Mixer (a buffer per speaker). Runs on a simulated clock, so a
+ * minute of audio takes well under a second.
+ * 
+ * usage: playout_bench [seconds] [jitter ms] [loss %] [playout delay ms]
+ *                      [speakers]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "core_audio.h++"
+#include "jitter_buffer.t++"
+#include "synthetic_stream.t++"
+#include "voice_codec.t++"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+
+/* same as max_payload_length in ../packet.h++ */
+static constexpr const std::size_t payload_limit = 1024;
+static constexpr const int sample_rate = Audio_Handle::sample_rate;
+
+struct Settings {
+    double seconds;
+    double jitter_ms;
+    double loss;
+    int delay_ms;
+    int speakers;
+};
+
+struct Arrival {
+    double time_ms;
+    std::vector<char> frame;
+    std::uint16_t source;
+};
+
+/**
+ * Records, encodes and sends one speaker's blocks, starting at start_ms,
+ * with a base delay of 20 ms plus exponentially distributed queueing delay;
+ * frames overtake each other freely. Doesn't sort what it adds.
+ */
+template <typename B>
+static void send(const Settings& settings, long blocks, double start_ms,
+                 std::uint16_t source, std::mt19937& random,
+                 std::vector<Arrival>& arrivals) {
+    const double block_ms = 1000.0 * B::frames / sample_rate;
+    Synthetic_Stream<sample_rate, B> microphone(440 + 110 * source, 8000,
+                                                false);
+    Voice_Encoder<Voice_Codec_t, B> encoder(payload_limit);
+    std::exponential_distribution<double> queueing(
+            settings.jitter_ms > 0 ? 1 / settings.jitter_ms : 1e9);
+    std::bernoulli_distribution lost(settings.loss);
+    
+    for (long n = 0; n < blocks; ++n) {
+        B block = microphone.record();
+        /* once it's all been captured */
+        double sent = start_ms + (n + 1) * block_ms;
+        std::size_t first = arrivals.size();
+        encoder.encode(block, [&](std::size_t bytes) {
+            arrivals.push_back({ sent + 20 + queueing(random),
+                                 std::vector<char>(bytes), source });
+            return arrivals.back().frame.data();
+        });
+        if (lost(random)) { arrivals.resize(first); }
+    }
+}
+
+static void sort_by_arrival(std::vector<Arrival>& arrivals) {
+    std::stable_sort(arrivals.begin(), arrivals.end(),
+                     [](const Arrival& a, const Arrival& b) {
+                         return a.time_ms < b.time_ms;
+                     });
+}
+
+static Clock_t::time_point at(Clock_t::time_point epoch, double ms) {
+    return epoch + std::chrono::duration_cast<Clock_t::duration>(
+            std::chrono::duration<double, std::milli>(ms));
+}
+
+/**
+ * Pushes one stream through the whole path with blocks of F frames and
+ * reports the mouth-to-ear latency and what the jitter buffer had to do.
+ */
+template <std::size_t F>
+static void run(const Settings& settings) {
+    using Block_t = Audio_Block<std::int16_t, 1, F>;
+    
+    const double block_ms = 1000.0 * F / sample_rate;
+    const long blocks = static_cast<long>(settings.seconds * 1000 / block_ms);
+    
+    Synthetic_Stream<sample_rate, Block_t> speaker(440, 8000, false);
+    
+    std::mt19937 random(7);
+    std::vector<Arrival> arrivals;
+    send<Block_t>(settings, blocks, 0, 0, random, arrivals);
+    sort_by_arrival(arrivals);
+    
+    /* the speaker ticks once a block from the start, half a block out of
+       step with the microphone */
+    Jitter_Buffer<Block_t> buffer(std::chrono::milliseconds(settings.delay_ms),
+                                  sample_rate);
+    Clock_t::time_point epoch = Clock_t::now();
+    
+    std::vector<double> latencies;
+    std::size_t next_arrival = 0;
+    long last = -1;
+    long ticks = blocks + static_cast<long>(1000 / block_ms);
+    for (long k = 0; k < ticks; ++k) {
+        double now = (k + 0.5) * block_ms;
+        if (next_arrival == arrivals.size()
+            && buffer.statistics().depth == 0) {
+            break; /* all played out */
+        }
+        while (next_arrival < arrivals.size()
+               && arrivals[next_arrival].time_ms <= now) {
+            const Arrival& a = arrivals[next_arrival++];
+            buffer.insert(a.frame.data(), a.frame.size(),
+                          at(epoch, a.time_ms));
+        }
+        
+        Block_t block = buffer.pop();
+        speaker.play(block);
+        
+        long sequence = buffer.last_sequence();
+        if (sequence != last) {
+            /* played a real block: mouth-to-ear latency runs from its
+               first sample going in to the same sample coming out */
+            latencies.push_back(now - sequence * block_ms);
+            last = sequence;
+        }
+    }
+    
+    auto stats = buffer.statistics();
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double l : latencies) { mean += l; }
+    mean /= latencies.empty() ? 1 : latencies.size();
+    double p99 = latencies.empty()
+               ? 0 : latencies[latencies.size() * 99 / 100];
+    
+    std::cout << std::setw(4) << F << " frames (" << std::fixed
+              << std::setprecision(1) << std::setw(4) << block_ms << " ms):"
+              << std::setw(7) << mean << " ms mean,"
+              << std::setw(7) << p99 << " ms p99,"
+              << std::setw(5) << stats.underruns << " underruns,"
+              << std::setw(6) << stats.concealed << " concealed,"
+              << std::setw(5) << stats.late << " late,"
+              << std::setw(5) << stats.skipped << " skipped, target "
+              << stats.target << " blocks, jitter "
+              << stats.jitter_ms << " ms" << std::endl;
+}
+
+/**
+ * Sends several speakers at once (each numbering their frames from 0,
+ * joining a second apart) and plays them through one Jitter_Buffer for
+ * everyone, then through a Voice_Mixer, reporting what each had to do.
+ */
+template <std::size_t F>
+static void run_speakers(const Settings& settings) {
+    using Block_t = Audio_Block<std::int16_t, 1, F>;
+    
+    const double block_ms = 1000.0 * F / sample_rate;
+    const long blocks = static_cast<long>(settings.seconds * 1000 / block_ms);
+    
+    std::mt19937 random(7);
+    std::vector<Arrival> arrivals;
+    for (int s = 0; s < settings.speakers; ++s) {
+        send<Block_t>(settings, blocks, 1000.0 * s,
+                      static_cast<std::uint16_t>(s), random, arrivals);
+    }
+    sort_by_arrival(arrivals);
+    
+    std::chrono::milliseconds delay(settings.delay_ms);
+    Jitter_Buffer<Block_t> shared(delay, sample_rate);
+    Voice_Mixer<Block_t> mixer(delay, sample_rate);
+    Clock_t::time_point epoch = Clock_t::now();
+    
+    std::size_t next_arrival = 0;
+    long ticks = blocks + static_cast<long>(1000 * settings.speakers
+                                            / block_ms);
+    for (long k = 0; k < ticks; ++k) {
+        double now = (k + 0.5) * block_ms;
+        while (next_arrival < arrivals.size()
+               && arrivals[next_arrival].time_ms <= now) {
+            const Arrival& a = arrivals[next_arrival++];
+            shared.insert(a.frame.data(), a.frame.size(),
+                          at(epoch, a.time_ms));
+            mixer.insert(a.source, a.frame.data(), a.frame.size(),
+                         at(epoch, a.time_ms));
+        }
+        shared.pop();
+        mixer.pop();
+    }
+    
+    auto report = [](const char* name, const auto& stats) {
+        std::cout << "  " << std::setw(14) << std::left << name << std::right
+                  << std::setw(7) << stats.played << " played,"
+                  << std::setw(6) << stats.underruns << " underruns,"
+                  << std::setw(6) << stats.concealed << " concealed,"
+                  << std::setw(6) << stats.late << " late,"
+                  << std::setw(5) << stats.skipped << " skipped"
+                  << std::endl;
+    };
+    std::cout << settings.speakers << " speakers, " << F << " frames, "
+              << blocks << " blocks each:" << std::endl;
+    report("one buffer:", shared.statistics());
+    report("buffer each:", mixer.statistics());
+}
+
+int main(int argc, char** argv) {
+    Settings settings;
+    settings.seconds   = argc > 1 ? std::atof(argv[1]) : 60;
+    settings.jitter_ms = argc > 2 ? std::atof(argv[2]) : 8;
+    settings.loss      = argc > 3 ? std::atof(argv[3]) / 100 : 0.01;
+    settings.delay_ms  = argc > 4 ? std::atoi(argv[4]) : 40;
+    settings.speakers  = argc > 5 ? std::atoi(argv[5]) : 3;
+    
+    std::cout << settings.seconds << " s of audio, 20 ms + ~"
+              << settings.jitter_ms << " ms network delay, "
+              << settings.loss * 100 << "% loss, "
+              << settings.delay_ms << " ms playout delay" << std::endl;
+    run<240>(settings);
+    run<480>(settings);
+    run<960>(settings);
+    if (settings.speakers > 1) { run_speakers<480>(settings); }
+    
+    return 0;
+}
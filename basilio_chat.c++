@@ -1,151 +1,547 @@
 #include "basilio_chat.h++"
 
-#include <iostream>
+#include <iomanip>
 #include <sstream>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
 #include <cstring>
 #include <cstdint>
 #include <thread>
-#include <mutex>
-#include <chrono> /* XXX */
+#include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+
+/* how many packets can wait to be sent in each lane, how many go out per
+   write, and how much of a write text gets before voice */
+static constexpr const std::size_t control_lane_capacity = 16;
+static constexpr const std::size_t text_lane_capacity = 256;
+static constexpr const std::size_t voice_lane_capacity = 64;
+static constexpr const std::size_t outbound_batch_size = 32;
+static constexpr const std::size_t text_batch_share = 24;
+
+/* how long voice may wait to be sent: the budget less half the round trip,
+   but never less than the floor */
+static constexpr const std::chrono::milliseconds voice_budget(150);
+static constexpr const std::chrono::milliseconds voice_deadline_floor(20);
+
+/* the longest hanging up waits for what's queued to go out */
+static constexpr const std::chrono::seconds hang_up_deadline(2);
+
+/* how often the server gets pinged to measure the round trip */
+static constexpr const std::chrono::seconds ping_interval(2);
+
+/* how far behind the other end incoming voice plays, at the least */
+static constexpr const std::chrono::milliseconds playout_delay(40);
+
+/* how many sent lines can be waiting on their echo before we forget some */
+static constexpr const std::size_t text_timestamp_capacity = 64;
+
+/* the most typed characters taken each time stdin is readable */
+static constexpr const std::size_t console_read_size = 256;
+
+/* how long stdin read from a file waits for a stalled send to clear */
+static constexpr const std::chrono::milliseconds console_file_retry(10);
+
+/* how many lines of history /back and /since show, and /search finds */
+static constexpr const std::uint64_t history_page = 20;
+static constexpr const std::size_t search_results = 20;
+
+/* no page of history shown yet; /back starts from the newest */
+static constexpr const std::uint64_t view_at_end = UINT64_MAX;
+
+/* the furthest back /since goes; far enough, and the clock can't overflow */
+static constexpr const std::chrono::hours max_since(24 * 365 * 100);
+
+/**
+ * Reads something like "90s", "15m", "2h" or "3d" (minutes if there's no
+ * unit), no more than max_since.
+ * 
+ * @return whether it made sense
+ */
+static bool parse_interval(const std::string& text,
+                           std::chrono::seconds& interval) {
+    const char* digits = text.c_str();
+    while (*digits == ' ') { ++digits; }
+    if (*digits < '0' || *digits > '9') { return false; } /* no signs */
+    
+    char* unit;
+    errno = 0;
+    unsigned long long count = std::strtoull(digits, &unit, 10);
+    if (errno == ERANGE) { return false; }
+    while (*unit == ' ') { ++unit; }
+    
+    unsigned long long unit_seconds;
+    switch (*unit) {
+    case 's': unit_seconds = 1; break;
+    case '\0':
+    case 'm': unit_seconds = 60; break;
+    case 'h': unit_seconds = 60 * 60; break;
+    case 'd': unit_seconds = 24 * 60 * 60; break;
+    default: return false;
+    }
+    
+    /* and nothing after it ("5mx" and "2 hours ago" don't count) */
+    if (*unit != '\0') { ++unit; }
+    while (*unit == ' ') { ++unit; }
+    if (*unit != '\0') { return false; }
+    
+    constexpr unsigned long long most = std::chrono::seconds(max_since)
+                                                .count();
+    if (count > most / unit_seconds) { return false; }
+    interval = std::chrono::seconds(count * unit_seconds);
+    return true;
+}
+
+/**
+ * @return whether some text is empty, or nothing but spaces
+ */
+static bool blank(const std::string& text) {
+    return text.find_first_not_of(' ') == std::string::npos;
+}
 
-void basilio_chat::process_console() {
-    bool running = true;
+void basilio_chat::process_console(const std::string& line) {
+    /* commands are a word, then whatever it takes */
+    std::size_t space = line.find(' ');
+    std::string command = line.substr(0, space);
+    std::string argument = space == std::string::npos ? ""
+                                                      : line.substr(space + 1);
     
-    while (running) {
-        std::string line = term.read_line();
+    /* check for exit command */
+    if (command == "/exit") {
+        /* prepare disconnect */
+/*      packet pack(1, packet_type::disconnect, false, "X");
         
-        /* check for exit command */
-        if (line.compare("/exit") == 0) {
-            running = false;
-            audio_active = false;
-            /* prepare disconnect */
-/*          packet pack(1, packet_type::disconnect, false, "X");
-            
-            try {
-                write_packet(sock, &pack);
-            } catch (socket::SocketException exc) {
-                term->write_err(std::string("exception in exit: ")
-                             += exc.what());
-            }*/
-            packet finish(0,
-                          packet_type::null_packet,
-                          false,
-                          nullptr);
-            std::unique_lock<std::mutex> lock(outbound_packets_sync);
-            outbound_packets.push(finish);
-            outbound_packets_cv.notify_one();
-        } else if (line.length() != 0) {
-            /* prepare packet */
-            packet pack(static_cast<packet_size>(line.length()),
-                        packet_type::plaintext,
-                        false,
-                        line.c_str());
-            std::unique_lock<std::mutex> lock(outbound_packets_sync);
-            outbound_packets.push(pack);
-            outbound_packets_cv.notify_one();
+        try {
+            write_packet(sock, &pack);
+        } catch (socket::SocketException exc) {
+            term->write_err(std::string("exception in exit: ")
+                         += exc.what());
+        }*/
+        hang_up();
+    } else if (command == "/search") {
+        if (blank(argument)) {
+            term.write_err("Usage: /search word...");
+        } else {
+            search_history(argument);
+        }
+    } else if (command == "/back") {
+        scroll_back();
+    } else if (command == "/since") {
+        if (blank(argument)) {
+            term.write_err("Usage: /since 15m (or 90s, 2h, 3d)");
+        } else {
+            scroll_since(argument);
+        }
+    } else if (line.length() != 0) {
+        if (connection.cancelled()) {
+            term.write_err("Not connected. Type /exit to exit.");
+            return;
+        }
+        view_first = view_at_end;
+        
+        /* prepare packet */
+        packet pack(static_cast<packet_size>(line.length()),
+                    packet_type::plaintext,
+                    false,
+                    line.c_str());
+        Clock_t::time_point now = Clock_t::now();
+        if (queue_packet(std::move(pack), lane::text)) {
+            text_sent_at.push(now);
+        } else {
+            term.write_err("The server isn't keeping up; line not sent.");
         }
     }
 }
 
+void basilio_chat::read_console() {
+    char typed[console_read_size];
+    ssize_t got = ::read(0, typed, sizeof(typed));
+    if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    } else if (got <= 0) { /* nobody left to type anything */
+        hang_up();
+        return;
+    }
+    
+    std::string line;
+    for (ssize_t i = 0; i < got && !disconnecting; ++i) {
+        if (term.feed(typed[i], line)) {
+            process_console(line);
+        }
+    }
+}
+
+void basilio_chat::read_console_file() {
+    /* a batch still going out holds the rest of the file back, so lines
+       don't pile up in the text lane faster than they can be sent */
+    if (outbound.pending()) {
+        console.after(console_file_retry, [this] { read_console_file(); });
+        return;
+    }
+    
+    read_console();
+    if (!disconnecting) { /* let everything else have a turn first */
+        console.after(Clock_t::duration::zero(),
+                      [this] { read_console_file(); });
+    }
+}
+
+bool basilio_chat::queue_packet(packet pack, lane which) {
+    if (outbound_packets.full(which)) { return false; }
+    outbound_packets.push(std::move(pack), which);
+    process_outbound_packets();
+    return true;
+}
+
 void basilio_chat::process_outbound_packets() {
-    bool running = true;
+    /* a batch still going out finishes first; meanwhile, new packets wait
+       in the lanes, where stale voice still gets dropped */
+    if (connection.cancelled() || outbound.pending()) { return; }
     
-    while (running) {
-        std::unique_lock<std::mutex> lock(outbound_packets_sync);
-        
-        /* check to see if anything's there */
-        if (outbound_packets.empty()) {
-            outbound_packets_cv.wait(lock, [this] {
-                return !outbound_packets.empty();
-            });
+    /* take however many are ready, in lane order, until there's none */
+    while (true) {
+        outbound_batch.clear();
+        if (outbound_packets.schedule(outbound_batch,
+                                      outbound_batch_size) == 0) {
+            if (disconnecting) { finish_hang_up(); } /* all out; we're done */
+            break;
         }
-        const packet next = outbound_packets.front();
-        outbound_packets.pop();
+        stats.outbound_depth.record(outbound_batch.size()
+                                    + outbound_packets.size_approx());
         
-        /* check for exit */
-        if (next.get_type() == packet_type::null_packet) { /* TODO: change */
-            running = false;
-        } else { /* send packet */
-            try {
-                write_packet(&sock, &next);
-            } catch (socket::SocketException exc) {
-                term.write_err(std::string("exception in send: ")
-                            += exc.what());
-                running = false;
+        try { /* send packets */
+            bool all_out = outbound.write_some(outbound_batch.data(),
+                                               outbound_batch.size());
+            
+            std::size_t bytes = 0;
+            for (const packet& pack : outbound_batch) {
+                bytes += header_length + pack.get_length();
+            }
+            stats.packets_sent.add(outbound_batch.size());
+            stats.bytes_sent.add(bytes);
+            stats.writes.add();
+            
+            if (!all_out) { /* the socket's full; wait until it isn't */
+                connection.rewatch(link.descriptor(), EPOLLIN | EPOLLOUT);
+                return;
             }
+        } catch (transport::exception& exc) {
+            abandon_outbound(exc);
+            return;
+        } catch (reactor::exception& exc) {
+            abandon_outbound(exc);
+            return;
         }
     }
+}
+
+void basilio_chat::resume_outbound() {
+    try {
+        if (!outbound.flush()) { return; }
+        connection.rewatch(link.descriptor(), EPOLLIN);
+    } catch (transport::exception& exc) {
+        abandon_outbound(exc);
+        return;
+    } catch (reactor::exception& exc) {
+        abandon_outbound(exc);
+        return;
+    }
     
-    sock.disconnect();
+    process_outbound_packets();
+}
+
+void basilio_chat::abandon_outbound(const std::exception& exc) {
+    term.write_err(std::string("exception in send: ") += exc.what());
+    connection.cancel();
+    if (disconnecting) { finish_hang_up(); } /* nothing more's going out */
 }
 
 void basilio_chat::process_server() {
-    bool running = true;
+    try {
+        while (inbound.fill() != 0) {
+            while (std::optional<packet> pack = inbound.poll()) {
+                handle_packet(*pack);
+            }
+        }
+    } catch (transport::end_of_stream& exc) {
+        if (!disconnecting) {
+            term.write_err("Server forcibly closed connection. Type /exit "
+                           "to exit.");
+        }
+        connection.cancel();
+    } catch (transport::exception& exc) {
+        term.write_err(std::string("exception in server handling: ")
+                    += exc.what());
+        connection.cancel();
+    }
+}
+
+void basilio_chat::handle_packet(const packet& pack) {
+    stats.packets_received.add();
+    stats.bytes_received.add(header_length + pack.get_length());
     
-    while (running) {
-        try {
-            packet pack = read_packet(&sock);
-            switch (pack.get_type()) {
-            default:
-            case packet_type::plaintext:
-                term.write_line(std::string(pack.get_payload(),
-                                            pack.get_length()));
-                if (bell_alert && !pack.is_self()) { std::cout.put('\x07'); }
-                break;
-            case packet_type::ping:
-                /* TODO: implement ping back */
-                break;
-            case packet_type::audio:
-                /* TODO: implement audio */
-                break;
+    switch (pack.get_type()) {
+    default:
+    case packet_type::plaintext:
+        if (pack.is_self()) { /* our own line, back from the server */
+            Clock_t::time_point sent;
+            if (text_sent_at.try_pop(sent)) {
+                stats.text_round_trip.record(
+                        std::chrono::duration_cast<std::chrono::microseconds>(
+                                Clock_t::now() - sent).count());
             }
-        } catch (basilio_chat::exception exc) {
-            term.write_err("Server forcibly closed connection. Type /exit to "
-                           "exit.");
-            running = false;
-        } catch (socket::SocketException exc) {
-            if (!sock.isConnected()) {
-                running = false;
-            } else {
-                term.write_err(std::string("exception in server handling: ")
-                            += exc.what());
+        }
+        term.write_line(std::string(pack.get_payload(), pack.get_length()));
+        if (bell_alert && !pack.is_self()) {
+            term.ring_bell();
+        }
+        log_message(pack);
+        break;
+    case packet_type::ping:
+        if (pack.is_self()) { /* our ping, back again */
+            std::int64_t sent;
+            if (pack.get_length() == sizeof(sent)) {
+                std::memcpy(&sent, pack.get_payload(), sizeof(sent));
+                note_round_trip(Clock_t::now()
+                                - Clock_t::time_point(Clock_t::duration(sent)));
             }
+        } else { /* someone wants to hear from us (now, not after the rest) */
+            queue_packet(packet(pack.get_length(), packet_type::ping, 0,
+                                pack.get_payload()),
+                         lane::control);
         }
+        break;
+    case packet_type::audio:
+        /* the server puts who said it in front */
+        if (voice && !pack.is_self()
+                && pack.get_length() > audio_source_length) {
+            const unsigned char* source
+                    = reinterpret_cast<const unsigned char*>(
+                            pack.get_payload());
+            audio_in.insert(static_cast<std::uint16_t>(
+                                    source[0] | source[1] << 8),
+                            pack.get_payload() + audio_source_length,
+                            pack.get_length() - audio_source_length);
+        }
+        break;
+    }
+}
+
+void basilio_chat::log_message(const packet& pack) {
+    if (!history) { return; }
+    
+    /* the server sends "name: text", and announcements without a name */
+    std::string_view text(pack.get_payload(), pack.get_length());
+    std::string_view sender;
+    std::size_t split = text.find(": ");
+    if (split != std::string_view::npos
+            && text.substr(0, split).find(' ') == std::string_view::npos) {
+        sender = text.substr(0, split);
+        text.remove_prefix(split + 2);
+    }
+    
+    try {
+        history->append(chat_log::Clock_t::now(), sender, text,
+                        pack.get_type(), pack.is_self());
+    } catch (chat_log::exception& exc) {
+        term.write_err(std::string("history off: ") += exc.what());
+        history.reset();
+    }
+}
+
+void basilio_chat::search_history(const std::string& query) {
+    if (!history) {
+        term.write_err("There's no history to search.");
+        return;
     }
+    
+    std::vector<std::uint64_t> found;
+    Clock_t::time_point start = Clock_t::now();
+    history->search(query, search_results, found);
+    double took = std::chrono::duration<double, std::milli>(
+            Clock_t::now() - start).count();
+    
+    std::ostringstream summary;
+    summary << "\x1b[33m" << (found.empty() ? "No" : "Newest")
+            << " lines with \"" << query << "\" (" << found.size()
+            << (found.size() == search_results ? " shown" : " found")
+            << " in " << std::fixed << std::setprecision(2) << took
+            << " ms)\x1b[0m";
+    term.write_line(summary.str());
+    for (auto next = found.rbegin(); next != found.rend(); ++next) {
+        show_history(*next);
+    }
+}
+
+void basilio_chat::scroll_back() {
+    if (!history) {
+        term.write_err("There's no history to scroll through.");
+        return;
+    }
+    
+    std::uint64_t end = std::min(view_first, history->size());
+    if (end == 0) {
+        term.write_line("\x1b[33mThat's as far back as the history goes."
+                        "\x1b[0m");
+        return;
+    }
+    view_first = end > history_page ? end - history_page : 0;
+    
+    std::ostringstream summary;
+    summary << "\x1b[33mHistory, " << view_first + 1 << " to " << end
+            << " of " << history->size() << ":\x1b[0m";
+    term.write_line(summary.str());
+    for (std::uint64_t i = view_first; i < end; ++i) { show_history(i); }
+}
+
+void basilio_chat::scroll_since(const std::string& ago) {
+    if (!history) {
+        term.write_err("There's no history to scroll through.");
+        return;
+    }
+    
+    std::chrono::seconds interval;
+    if (!parse_interval(ago, interval)) {
+        term.write_err("Try something like /since 15m (or 90s, 2h, 3d), "
+                       "up to 100 years back.");
+        return;
+    }
+    
+    std::uint64_t first = history->find_time(chat_log::Clock_t::now()
+                                             - interval);
+    std::uint64_t end = std::min(history->size(), first + history_page);
+    if (first == end) {
+        term.write_line("\x1b[33mNothing's been said since then.\x1b[0m");
+        return;
+    }
+    view_first = first;
+    
+    std::ostringstream summary;
+    summary << "\x1b[33mHistory, " << first + 1 << " to " << end << " of "
+            << history->size() << " (/back for before):\x1b[0m";
+    term.write_line(summary.str());
+    for (std::uint64_t i = first; i < end; ++i) { show_history(i); }
+}
+
+void basilio_chat::show_history(std::uint64_t index) {
+    chat_log::entry said = history->at(index);
+    std::time_t when = chat_log::Clock_t::to_time_t(said.time);
+    std::tm local;
+    ::localtime_r(&when, &local);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M", &local);
+    
+    std::string line("\x1b[36m");
+    line.append(stamp).append("  ");
+    if (!said.sender.empty()) { line.append(said.sender).append(": "); }
+    line.append(said.text).append("\x1b[0m");
+    term.write_line(line);
 }
 
-void basilio_chat::process_microphone() {
+void basilio_chat::note_round_trip(Clock_t::duration round_trip) {
+    auto sample = std::chrono::duration_cast<std::chrono::microseconds>(
+            round_trip).count();
+    stats.ping_round_trip.record(sample);
+    
+    /* smooth it the way TCP does, over about eight samples */
+    std::int64_t smoothed = smoothed_round_trip.load();
+    smoothed = smoothed == 0 ? sample : smoothed + (sample - smoothed) / 8;
+    smoothed_round_trip.store(smoothed);
+    
+    /* a slower link leaves voice less time to wait before it goes out */
+    auto deadline = voice_budget - std::chrono::microseconds(smoothed / 2);
+    outbound_packets.set_voice_deadline(
+            deadline > voice_deadline_floor ? deadline : voice_deadline_floor);
+}
+
+void basilio_chat::process_audio() {
+    /* leave room for the source id the server adds */
+    Voice_Encoder<Voice_Codec_t, Audio_Handle::Block_t>
+            encoder(max_payload_length - audio_source_length);
+    std::vector<packet> frames;
+    frames.reserve(encoder.frames_per_block());
+    
     while (audio_active) {
         try {
             /* read a block of audio */
             Audio_Handle::Block_t block = audio_handle->record_block();
-            packet pack(block.channel().size() * Audio_Handle::sample_size,
-                        packet_type::audio);
+            Clock_t::time_point captured = Clock_t::now();
+            
+            /* encode it straight into packet payloads */
+            encoder.encode(block, [&frames](std::size_t bytes) {
+                frames.emplace_back(static_cast<packet_size>(bytes),
+                                    packet_type::audio);
+                return &frames.back()[0];
+            });
             
-            /* copy the audio into the packet */
-            int pack_index = 0;
-            /* XXX, assumes int */
-            for (Audio_Handle::Sample_t n : block.channel()) {
-                for (int i = 0; i < Audio_Handle::sample_size; ++i) {
-                    pack[pack_index++] = static_cast<char>(n & 0xFF);
-                    n >>= 8;
-                }
+            /* send the packets off to the output queue, and have the loop
+               send them (once, however many blocks pile up meanwhile) */
+            for (packet& frame : frames) {
+                outbound_packets.push_voice(std::move(frame), captured);
+            }
+            frames.clear();
+            if (!flush_posted.exchange(true)) {
+                loop.post([this] {
+                    flush_posted = false;
+                    process_outbound_packets();
+                });
             }
             
-            /* send the packet off to the output queue */
-            std::unique_lock<std::mutex> lock(outbound_packets_sync);
-            outbound_packets.push(pack);
-            outbound_packets_cv.notify_one();
+            /* then play; the stream blocks until there's room, which paces
+               this along with recording */
+            Audio_Handle::Block_t heard = audio_in.pop();
+            audio_handle->play_block(heard);
         } catch (Audio_Use_Exception& exc) {
             term.write_line(exc.what());
         }
     }
 }
 
-void basilio_chat::process_speakers() {
+void basilio_chat::redraw() {
+    Clock_t::time_point due = term.draw();
+    if (due != Clock_t::time_point::max() && !draw_scheduled) {
+        draw_scheduled = true;
+        console.after(due - Clock_t::now(), [this] {
+            draw_scheduled = false;
+            redraw();
+        });
+    }
+}
+
+void basilio_chat::hang_up() {
+    if (disconnecting) { return; }
+    disconnecting = true;
+    audio_active = false;
     
+    /* what's queued (the last line typed, like as not) goes out first:
+       process_outbound_packets() finishes up once the lanes are empty, or
+       resume_outbound() does once a stalled batch is out, unless the server
+       takes too long */
+    session.after(hang_up_deadline, [this] { finish_hang_up(); });
+    if (connection.cancelled()) {
+        finish_hang_up();
+    } else {
+        process_outbound_packets();
+    }
+}
+
+void basilio_chat::finish_hang_up() {
+    if (session.cancelled()) { return; }
+    link.shutdown();
+    session.cancel();
+    loop.stop();
 }
 
 /*----------------------------------------------------------------------------*/
@@ -172,50 +568,206 @@ void basilio_chat::bell_toggle_command::operator()() {
 
 /*----------------------------------------------------------------------------*/
 
+basilio_chat::stats_command::stats_command(basilio_chat& chat) : chat(chat) { }
+
+void basilio_chat::stats_command::operator()() {
+    for (const std::string& line : chat.report()) {
+        chat.term.write_line(std::string("\x1b[33m").append(line)
+                                                    .append("\x1b[0m"));
+    }
+}
+
+std::vector<std::string> basilio_chat::report() const {
+    std::vector<std::string> lines;
+    std::ostringstream line;
+    auto next_line = [&lines, &line] {
+        lines.push_back(line.str());
+        line.str("");
+    };
+    
+    line << "packets: " << stats.packets_sent.get() << " sent ("
+         << stats.bytes_sent.get() << " bytes in " << stats.writes.get()
+         << " writes), " << stats.packets_received.get() << " received ("
+         << stats.bytes_received.get() << " bytes)";
+    next_line();
+    line << "outbound queue depth: " << stats.outbound_depth.summary();
+    next_line();
+    line << "text round trip: " << stats.text_round_trip.summary("us");
+    next_line();
+    line << "ping round trip: " << stats.ping_round_trip.summary("us")
+         << ", smoothed " << smoothed_round_trip.load() << " us";
+    next_line();
+    if (voice) {
+        line << "voice out: " << outbound_packets.stale_voice()
+             << " frames too old to send, "
+             << outbound_packets.overflowed_voice()
+             << " pushed out of a full queue, deadline "
+             << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        outbound_packets.voice_deadline()).count() << " ms";
+        next_line();
+        auto audio = audio_in.statistics();
+        line << "voice in: " << audio.sources << " speakers, "
+             << audio.played << " played, " << audio.concealed
+             << " concealed, " << audio.underruns << " underruns, "
+             << audio.late << " late, " << audio.skipped << " skipped, "
+             << audio.depth << '/' << audio.target << " blocks buffered, "
+             << audio.jitter_ms << " ms jitter";
+        next_line();
+    }
+    line << "display: " << term.frames_drawn() << " frames, "
+         << term.bytes_written() << " bytes";
+    next_line();
+    
+    return lines;
+}
+
+/*----------------------------------------------------------------------------*/
+
 basilio_chat::basilio_chat(const std::string& address,
                            const std::string& port,
                            const std::string& username,
-                           bool debug, bool voice)
-: address(address), port(port), username(username), debug(debug), voice(voice),
-  bell_alert(false), bell_command_ref(bell_alert, &term), audio_active(true),
-  audio_handle(voice ? new Audio_Handle() : nullptr) { }
+                           bool debug, bool voice,
+                           const std::string& history)
+: socket_fildes(-1), socket_link(-1), link(socket_link), connect_socket(true),
+  disconnecting(false), inbound(link), outbound(link),
+  session(loop), connection(session), console(session), draw_scheduled(false),
+  term(terminal::display::default_frame_rate, 1, false),
+  bell_alert(false), bell_command_ref(bell_alert, &term),
+  stats_command_ref(*this),
+  address(address), port(port), username(username), debug(debug), voice(voice),
+  outbound_packets(control_lane_capacity, text_lane_capacity,
+                   voice_lane_capacity, text_batch_share, voice_budget),
+  flush_posted(false),
+  audio_handle(voice ? new Audio_Handle() : nullptr), audio_active(true),
+  smoothed_round_trip(0),
+  audio_in(playout_delay, Audio_Handle::sample_rate),
+  history_path(history), view_first(view_at_end),
+  text_sent_at(text_timestamp_capacity, overflow_policy::drop_oldest) {
+    outbound_batch.reserve(outbound_batch_size);
+}
+
+basilio_chat::basilio_chat(fd_transport& link,
+                           const std::string& username,
+                           std::unique_ptr<Audio_Handle> audio_handle,
+                           int output, bool debug,
+                           const std::string& history)
+: socket_fildes(-1), socket_link(-1), link(link), connect_socket(false),
+  disconnecting(false), inbound(link), outbound(link),
+  session(loop), connection(session), console(session), draw_scheduled(false),
+  term(terminal::display::default_frame_rate, output, false),
+  bell_alert(false), bell_command_ref(bell_alert, &term),
+  stats_command_ref(*this),
+  username(username), debug(debug), voice(audio_handle != nullptr),
+  outbound_packets(control_lane_capacity, text_lane_capacity,
+                   voice_lane_capacity, text_batch_share, voice_budget),
+  flush_posted(false),
+  audio_handle(std::move(audio_handle)), audio_active(true),
+  smoothed_round_trip(0),
+  audio_in(playout_delay, Audio_Handle::sample_rate),
+  history_path(history), view_first(view_at_end),
+  text_sent_at(text_timestamp_capacity, overflow_policy::drop_oldest) {
+    outbound_batch.reserve(outbound_batch_size);
+}
+
+basilio_chat::~basilio_chat() {
+    if (socket_fildes >= 0) { ::close(socket_fildes); }
+}
 
 void basilio_chat::main() {
-    std::ostringstream out_stream;
-    out_stream << "Connecting to " << address << ':' << port
-               << " as " << username << "...";
-    term.write_line(out_stream.str());
+    /* a server hanging up mid-write should fail the write, not kill us */
+    std::signal(SIGPIPE, SIG_IGN);
     
-    bool success = sock.connect(address.c_str(), port.c_str());
-    if (!success) {
-        throw basilio_chat::exception(std::string("could not connect to ")
-                                      += address);
+    /* the display draws from the loop; updates from elsewhere ask for it */
+    term.on_update([this] { loop.post([this] { redraw(); }); });
+    redraw();
+    
+    if (!history_path.empty()) {
+        try {
+            history.reset(new chat_log(history_path));
+        } catch (chat_log::exception& exc) {
+            term.write_err(std::string("history off: ") += exc.what());
+        }
     }
     
-    /* XXX */
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    if (connect_socket) {
+        std::ostringstream out_stream;
+        out_stream << "Connecting to " << address << ':' << port
+                   << " as " << username << "...";
+        term.write_line(out_stream.str());
+        redraw();
+        
+        socket_fildes = fd_transport::connect(address, port);
+        socket_link = fd_transport(socket_fildes);
+    }
     
     /* send username over */
     packet uname(username.length(), packet_type::join, false, username.c_str());
-    write_packet(&sock, &uname);
+    outbound.write(uname);
+    
+    /* from here on, reads take what's there and writes send what fits */
+    int fildes = link.descriptor();
+    ::fcntl(fildes, F_SETFL, ::fcntl(fildes, F_GETFL) | O_NONBLOCK);
     
     /* register commands */
     /* TODO: change the command system to '/'-style commands and rename this
              sort of thing to "keybinds" or whatever */
     term.register_command('l', &bell_command_ref);
+    term.register_command('p', &stats_command_ref);
+    
+    /* the server (and room to write to it, when a batch is stuck), and
+       pinging it now and then (it answers ahead of everything) */
+    connection.watch(fildes, EPOLLIN, [this](std::uint32_t events) {
+        if (events & EPOLLOUT) { resume_outbound(); }
+        if ((events & ~EPOLLOUT) != 0 && !connection.cancelled()) {
+            process_server();
+        }
+    });
+    auto ping = [this] {
+        std::int64_t now = Clock_t::now().time_since_epoch().count();
+        queue_packet(packet(sizeof(now), packet_type::ping, 0,
+                            reinterpret_cast<const char*>(&now)),
+                     lane::control);
+    };
+    ping();
+    connection.every(ping_interval, ping);
+    
+    /* the keyboard, and redrawing when the window's resized */
+    struct stat input;
+    if (::fstat(0, &input) == 0 && S_ISREG(input.st_mode)) {
+        read_console_file(); /* epoll won't take a file, but it's never idle */
+    } else {
+        console.watch(0, EPOLLIN, [this](std::uint32_t) { read_console(); });
+    }
+    if (term.resize_descriptor() >= 0) {
+        console.watch(term.resize_descriptor(), EPOLLIN, [this](std::uint32_t) {
+            redraw();
+        });
+    }
     
-    /* start threads */
-    std::thread console([&] { process_console(); });
-    std::thread server([&] { process_server(); });
-    std::thread packets([&] { process_outbound_packets(); });
-    std::thread microphone;
-    if (voice) { microphone = std::thread([&] { process_microphone(); }); }
-    
-    /* join threads */
-    console.join();
-    server.join();
-    packets.join();
-    if (voice) { microphone.join(); }
+    /* voice gets the one thread of its own, since the sound card blocks */
+    std::thread audio;
+    if (voice) {
+        audio = std::thread([&] { process_audio(); });
+    }
+    
+    try {
+        loop.run();
+    } catch (...) { /* voice has to stop before anyone hears about it */
+        audio_active = false;
+        if (voice) {
+            audio.join();
+        }
+        throw;
+    }
+    
+    audio_active = false;
+    if (voice) {
+        audio.join();
+    }
+    
+    if (debug) {
+        for (const std::string& line : report()) { term.write_line(line); }
+    }
 }
 
 void basilio_chat::write_line(const std::string& line) {
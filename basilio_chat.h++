@@ -1,6 +1,6 @@
 /**
  * A neat little program to communicate with a friend.
- *
+ * 
  * @author Charles Van West
  * @version 0
  */
@@ -10,20 +10,30 @@
 
 #include "terminal/terminal_manager.h++"
 #include "packet.h++"
-#include "../socket/Socket.h++"
+#include "framing.h++"
+#include "transport.h++"
+#include "ring_queue.t++"
+#include "packet_lanes.h++"
+#include "stats.h++"
+#include "reactor.h++"
+#include "chat_log.h++"
 #include "audio/core_audio.h++"
+#include "audio/voice_codec.t++"
+#include "audio/jitter_buffer.t++"
 
 #include <string>
 #include <exception>
 #include <atomic>
-#include <queue>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace vanwestco {
 
 /**
  * Represents an instantiation of the program.
- *
+ * 
  */
 class basilio_chat {
 public:
@@ -36,6 +46,7 @@ public:
      * @param the username to use
      * @param whether debug mode is on (one never knows with Basilio)
      * @param whether voice chat is enabled
+     * @param the directory to keep the chat history in (empty for none)
      * 
      * @throws Audio_Exception
      * @throws Audio_Use_Exception
@@ -44,7 +55,51 @@ public:
                  const std::string& port,
                  const std::string& username,
                  bool debug = false,
-                 bool voice = false);
+                 bool voice = false,
+                 const std::string& history = "");
+    
+    /**
+     * Constructs a basilio_chat that talks over a descriptor somebody else has
+     * already connected, with voice going through the given audio handle.
+     * main() then skips connecting (but does make the descriptor
+     * non-blocking). This is how chat_harness runs the whole client without a
+     * server or a sound card.
+     * 
+     * @param link the connected transport (not owned)
+     * @param username the username to use
+     * @param audio_handle where voice is recorded and played (nullptr for no
+     *                     voice)
+     * @param output the file descriptor the terminal draws on
+     * @param debug whether debug mode is on
+     * @param history the directory to keep the chat history in (empty for
+     *                none)
+     */
+    basilio_chat(fd_transport& link,
+                 const std::string& username,
+                 std::unique_ptr<Audio_Handle> audio_handle = nullptr,
+                 int output = 1,
+                 bool debug = false,
+                 const std::string& history = "");
+    
+    /**
+     * Closes the connection, if this made it.
+     */
+    ~basilio_chat();
+    
+    /**
+     * What the client keeps count of as it runs. It's all relaxed atomics, so
+     * it's cheap enough to leave on and safe to read from any thread.
+     */
+    struct statistics {
+        counter packets_sent;
+        counter bytes_sent;
+        counter writes;             /* gathered writes to the transport */
+        counter packets_received;
+        counter bytes_received;
+        histogram outbound_depth;   /* packets waiting, each time we drain */
+        histogram text_round_trip;  /* us from Enter to the server's echo */
+        histogram ping_round_trip;  /* us for a ping to come back */
+    };
     
     /**
      * Toggles whether a bell character is printed as an alert when a message
@@ -54,7 +109,7 @@ public:
     public:
         /**
          * Constructs a command instance with an atomic<bool> to toggle.
-         *
+         * 
          * @param flag the bool to toggle
          * @param term the terminal to write notifications to
          */
@@ -69,6 +124,24 @@ public:
         terminal* term;
     };
     
+    /**
+     * Writes a snapshot of the client's statistics to the terminal.
+     */
+    class stats_command : public terminal::command {
+    public:
+        /**
+         * @param chat the program to report on
+         */
+        stats_command(basilio_chat& chat);
+        
+        /**
+         * Writes the report.
+         */
+        void operator()();
+    private:
+        basilio_chat& chat;
+    };
+    
     /**
      * Generic exception class for this program.
      */
@@ -81,11 +154,13 @@ public:
     };
     
     /**
-     * Runs the main bits of the program.
+     * Runs the main bits of the program: everything but the sound card is
+     * driven from one event loop on the calling thread, and voice (if it's
+     * on) gets one thread more. Returns after /exit.
      * 
-     * @throws vanwestco::socket::SocketException if something goes wrong with
-     *                                            the nextwork (see 
-     *                                            ../socket/Socket.hh)
+     * @throws vanwestco::transport::exception if the connection can't be made
+     *                                         or the join can't be sent
+     * @throws vanwestco::reactor::exception if the event loop can't be set up
      * @throws vanwestco::basilio_chat::exception if something else happens
      */
     void main();
@@ -101,46 +176,172 @@ public:
      * @see write_line(const std::string& line)
      */
     void write_line(const char* line);
+    
+    /**
+     * @return the counters
+     */
+    const statistics& counters() const { return stats; }
+    
+    /**
+     * Summarizes the counters, along with what the jitter buffer and the
+     * display have been up to, as lines fit for the terminal.
+     * 
+     * @return the lines
+     */
+    std::vector<std::string> report() const;
 private:
     /**
-     * Reads text and commands from the console and sends packets to the
-     * outbound packet queue.
-     *
-     * @param term the terminal to read from
+     * Acts on a line typed at the console: /exit hangs up, /search, /back and
+     * /since look through the history, and anything else is sent as text.
+     * 
+     * @param line the line
      */
-    void process_console();
+    void process_console(const std::string& line);
     
     /**
-     * Reads packets from the outbound queue and sends them to the server.
+     * Takes whatever's been typed, when stdin is readable, and hands it to
+     * the terminal a character at a time.
+     */
+    void read_console();
+    
+    /**
+     * Does what read_console() does when stdin is a regular file, which
+     * epoll can't watch: reads a piece at a time, in turns with the rest of
+     * the loop, until the end of the file hangs up.
+     */
+    void read_console_file();
+    
+    /**
+     * Queues a control or text packet from the loop and sends what it can.
+     * Never waits for room in the lane, since only the loop makes any.
      * 
-     * @param sock the socket to send packets to
-     * @param term the terminal to write error messages to
+     * @param pack the packet
+     * @param which lane::control or lane::text
+     * @return false if the lane was full and the packet was dropped
+     */
+    bool queue_packet(packet pack, lane which);
+    
+    /**
+     * Sends everything the lanes have waiting, in lane order, a batch per
+     * write. If the socket fills up, the rest of the batch waits for it to
+     * be writable again and everything else stays in the lanes.
      */
     void process_outbound_packets();
     
     /**
-     * Reads packets and prints them to the console.
-     *
-     * @param sock the socket to read packets from.
-     * @param term the terminal to write to
+     * Carries on with a batch the socket wouldn't take all of, when it's
+     * writable again, then goes back to the lanes.
+     */
+    void resume_outbound();
+    
+    /**
+     * Gives up on sending after a write (or watching for room to write)
+     * fails: reports it and drops the connection (and finishes hanging up,
+     * if that was what was going on).
+     * 
+     * @param exc what went wrong
+     */
+    void abandon_outbound(const std::exception& exc);
+    
+    /**
+     * Reads whatever the server has sent, when the socket is readable, and
+     * acts on each whole packet.
      */
     void process_server();
     
     /**
-     * Reads audio data from the microphone and puts it into the outbound
-     * audio queue.
+     * Acts on one packet from the server.
+     * 
+     * @param pack the packet
+     */
+    void handle_packet(const packet& pack);
+    
+    /**
+     * Adds a line from the server to the history, splitting off who said it.
+     * 
+     * @param pack the packet it came in
+     */
+    void log_message(const packet& pack);
+    
+    /**
+     * Writes the newest lines in the history with every word of a query,
+     * oldest first.
+     * 
+     * @param query the words
      */
-    void process_microphone();
+    void search_history(const std::string& query);
     
     /**
-     * Reads audio data from the inbound queue and plays it over the speakers.
+     * Writes the page of history before the last one shown (or the newest
+     * page, to start with).
      */
-    void process_speakers();
+    void scroll_back();
+    
+    /**
+     * Writes the page of history starting a while ago, e.g. "90s", "15m",
+     * "2h" or "3d" (minutes if there's no unit).
+     * 
+     * @param ago how long ago
+     */
+    void scroll_since(const std::string& ago);
+    
+    /**
+     * Writes one line of history, with its time.
+     * 
+     * @param index which line
+     */
+    void show_history(std::uint64_t index);
+    
+    /**
+     * Records a ping's round trip and shortens or lengthens how long voice
+     * may wait to go out accordingly.
+     * 
+     * @param round_trip how long the ping took
+     */
+    void note_round_trip(std::chrono::steady_clock::duration round_trip);
+    
+    /**
+     * The audio thread: records a block from the microphone and hands its
+     * frames to the voice lane, then plays the next block out of the jitter
+     * buffer. The sound card paces both.
+     */
+    void process_audio();
+    
+    /**
+     * Draws the terminal, or schedules a draw for when the frame rate allows.
+     */
+    void redraw();
+    
+    /**
+     * Stops taking input and sends what's left, then finishes hanging up
+     * once it's out (or hang_up_deadline passes, or the connection drops).
+     */
+    void hang_up();
+    
+    /**
+     * Shuts the connection and stops the loop.
+     */
+    void finish_hang_up();
+    
+    int socket_fildes;          /* ours to close, if we connected it */
+    fd_transport socket_link;
+    fd_transport& link;         /* socket_link, unless we were handed one */
+    bool connect_socket;
+    bool disconnecting;         /* hung up; sending what's left */
+    frame_reader inbound;
+    frame_writer outbound;
+    
+    /* everything but the audio thread runs in here */
+    reactor loop;
+    task_scope session;         /* all of it */
+    task_scope connection;      /* the socket and the pings */
+    task_scope console;         /* stdin and the display */
+    bool draw_scheduled;        /* a redraw's waiting on the frame rate */
     
-    socket::Socket sock;
     terminal term;
     std::atomic<bool> bell_alert;
     bell_toggle_command bell_command_ref;
+    stats_command stats_command_ref;
     
     std::string address;
     std::string port;
@@ -148,15 +349,24 @@ private:
     bool debug;
     bool voice;
     
-    /* TODO: update to use sync_queue */
-    std::queue<packet> outbound_packets;
-    std::mutex outbound_packets_sync;
-    std::condition_variable outbound_packets_cv;
+    /* the console, the audio thread and pings all push here */
+    packet_lanes outbound_packets;
+    std::vector<packet> outbound_batch; /* kept until outbound's written it */
+    std::atomic<bool> flush_posted; /* the audio thread's asked for a send */
     
     std::unique_ptr<Audio_Handle> audio_handle;
-    bool audio_active;
-    std::queue<Audio_Handle::Block_t> audio_in;
-    std::queue<Audio_Handle::Block_t> audio_out;
+    std::atomic<bool> audio_active;
+    std::atomic<std::int64_t> smoothed_round_trip; /* us, 0 until measured */
+    Voice_Mixer<Audio_Handle::Block_t> audio_in; /* a buffer per speaker */
+    
+    /* what's been said, on disk */
+    std::string history_path;
+    std::unique_ptr<chat_log> history;
+    std::uint64_t view_first;   /* start of the last page of history shown */
+    
+    statistics stats;
+    /* when each line still waiting for its echo was sent */
+    spsc_queue<std::chrono::steady_clock::time_point> text_sent_at;
 };
 
 } /* ~namespace vanwestco */
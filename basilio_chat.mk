@@ -1,4 +1,11 @@
-OBJECTS = basilio_chat.o packet.o
+OBJECTS = basilio_chat.o packet.o payload_pool.o transport.o framing.o \
+          packet_lanes.o stats.o reactor.o chat_log.o
+FRAMING_OBJECTS = packet.o payload_pool.o transport.o framing.o
+
+# the codec and audio block size; the top-level makefile passes these down
+# (to audio/makefile too), so set them there
+CODEC_MACRO =
+FRAMES_MACRO =
 
 OS_NAME := $(shell uname -s)
 
@@ -8,17 +15,81 @@ else ifeq ($(OS_NAME), Darwin) #on a mac
 		LIBRARY_LINK = -lportaudio -largp
 endif
 
-basilio_chat: main.c++ basilio_chat.o packet.o terminal/terminal.o ../socket/socket.o audio/core_audio.o
+# everything that includes basilio_chat.h++ sees the audio block and codec
+# types, so it all has to be built with the same macros
+CHAT_HEADERS = basilio_chat.h++ packet.h++ framing.h++ transport.h++ \
+               payload_pool.h++ ring_queue.t++ packet_lanes.h++ stats.h++ \
+               reactor.h++ chat_log.h++ audio/voice_codec.t++ \
+               audio/jitter_buffer.t++ audio/core_audio.h++ \
+               terminal/terminal_manager.h++ macros.stamp
+
+basilio_chat: main.o $(OBJECTS) terminal/terminal.o audio/core_audio.o
 	c++ $(LIBRARY_LINK) \
-	-o basilio_chat main.c++ basilio_chat.o packet.o terminal/terminal.o \
-	../socket/socket.o audio/core_audio.o
+	-o basilio_chat main.o $(OBJECTS) terminal/terminal.o audio/core_audio.o
+
+main.o: main.c++ $(CHAT_HEADERS)
+	c++ $(CODEC_MACRO) $(FRAMES_MACRO) -c -o main.o main.c++
+
+basilio_chat.o: basilio_chat.c++ $(CHAT_HEADERS)
+	c++ -O2 $(CODEC_MACRO) $(FRAMES_MACRO) -c -o basilio_chat.o basilio_chat.c++
+
+# rewritten only when the macros change, so what depends on it gets rebuilt
+macros.stamp: FORCE
+	@echo '$(CODEC_MACRO) $(FRAMES_MACRO)' | cmp -s - macros.stamp \
+	|| echo '$(CODEC_MACRO) $(FRAMES_MACRO)' > macros.stamp
+
+packet.o: packet.c++ packet.h++ payload_pool.h++
+	c++ -O2 -c -o packet.o packet.c++
+
+payload_pool.o: payload_pool.c++ payload_pool.h++ packet.h++
+	c++ -O2 -c -o payload_pool.o payload_pool.c++
+
+transport.o: transport.c++ transport.h++
+	c++ -O2 -c -o transport.o transport.c++
+
+packet_lanes.o: packet_lanes.c++ packet_lanes.h++ packet.h++ payload_pool.h++ \
+                ring_queue.t++ stats.h++
+	c++ -O2 -c -o packet_lanes.o packet_lanes.c++
+
+stats.o: stats.c++ stats.h++
+	c++ -O2 -c -o stats.o stats.c++
+
+reactor.o: reactor.c++ reactor.h++
+	c++ -O2 -c -o reactor.o reactor.c++
+
+chat_log.o: chat_log.c++ chat_log.h++ packet.h++ payload_pool.h++
+	c++ -O2 -c -o chat_log.o chat_log.c++
+
+framing.o: framing.c++ framing.h++ packet.h++ payload_pool.h++ transport.h++
+	c++ -O2 -c -o framing.o framing.c++
+
+packet_bench: packet_bench.c++ $(FRAMING_OBJECTS)
+	c++ -O2 -lpthread -o packet_bench packet_bench.c++ $(FRAMING_OBJECTS)
+
+chat_harness: chat_harness.c++ $(CHAT_HEADERS) $(OBJECTS) terminal/terminal.o \
+              audio/core_audio.o
+	c++ -O2 $(CODEC_MACRO) $(FRAMES_MACRO) $(LIBRARY_LINK) \
+	-o chat_harness chat_harness.c++ $(OBJECTS) terminal/terminal.o \
+	audio/core_audio.o
+
+lanes_bench: lanes_bench.c++ packet_lanes.o stats.o $(FRAMING_OBJECTS)
+	c++ -O2 -lpthread -o lanes_bench lanes_bench.c++ packet_lanes.o stats.o \
+	$(FRAMING_OBJECTS)
+
+reactor_bench: reactor_bench.c++ reactor.o
+	c++ -O2 -lpthread -o reactor_bench reactor_bench.c++ reactor.o
+
+log_bench: log_bench.c++ chat_log.o
+	c++ -O2 -o log_bench log_bench.c++ chat_log.o
 
-basilio_chat.o: basilio_chat.c++ basilio_chat.h++
-	c++ -c -o basilio_chat.o basilio_chat.c++
+queue_bench: queue_bench.c++ ring_queue.t++
+	c++ -O2 -lpthread -o queue_bench queue_bench.c++
 
-packet.o: packet.c++ packet.h++
-	c++ -c -o packet.o packet.c++
+.PHONY: FORCE
+FORCE:
 
 .PHONY: clean
 clean:
-	-rm basilio_chat $(OBJECTS)
+	-rm basilio_chat chat_harness packet_bench queue_bench lanes_bench \
+	reactor_bench log_bench \
+	main.o macros.stamp $(OBJECTS)
@@ -0,0 +1,479 @@
+#include "basilio_server.h++"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace vanwestco;
+
+namespace server_constants {
+/* how many events one epoll_wait() can hand back */
+static constexpr const int max_events = 256;
+
+/* reads from one client per round before giving everyone else a turn */
+static constexpr const int read_budget = 8;
+
+/* longest name a client can go by */
+static constexpr const std::size_t max_name_length = 32;
+
+/* relayed frames: both headers plus the biggest payload */
+static constexpr const std::size_t frame_block_size
+        = 2 * header_length + max_payload_length;
+static constexpr const std::size_t frame_preallocate = 64;
+} /* ~namespace server_constants */
+
+static std::string error_string(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+/*----------------------------------------------------------------------------*/
+
+basilio_server::exception::exception(const std::string& ms) : message(ms) { }
+
+const char* basilio_server::exception::what() const noexcept {
+    return message.c_str();
+}
+
+/* oversized frames are refused from their header, before they're buffered */
+basilio_server::client::client(int fildes, std::uint16_t id)
+: fildes(fildes), id(id), link(fildes),
+  inbound(link, header_length + max_payload_length) { }
+
+/*----------------------------------------------------------------------------*/
+
+basilio_server::basilio_server(const std::string& port,
+                               std::size_t send_limit, bool debug)
+: listener(-1), poller(-1), wakeup(-1), send_limit(send_limit), debug(debug),
+  running(false), frames(server_constants::frame_block_size,
+                         server_constants::frame_preallocate) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    
+    addrinfo* found;
+    int err = ::getaddrinfo(nullptr, port.c_str(), &hints, &found);
+    if (err != 0) {
+        throw exception(std::string("bad port: ") + ::gai_strerror(err));
+    }
+    
+    listener = ::socket(found->ai_family,
+                        found->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        found->ai_protocol);
+    if (listener < 0) {
+        ::freeaddrinfo(found);
+        throw exception(error_string("socket failed"));
+    }
+    
+    int on = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    bool bound = ::bind(listener, found->ai_addr, found->ai_addrlen) == 0;
+    ::freeaddrinfo(found);
+    if (!bound || ::listen(listener, SOMAXCONN) != 0) {
+        std::string message = error_string(("couldn't listen on " + port).c_str());
+        ::close(listener);
+        throw exception(message);
+    }
+    
+    poller = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeup = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (poller < 0 || wakeup < 0) {
+        std::string message = error_string("couldn't set up epoll");
+        ::close(listener);
+        if (poller >= 0) { ::close(poller); }
+        if (wakeup >= 0) { ::close(wakeup); }
+        throw exception(message);
+    }
+    
+    epoll_event watch;
+    watch.events = EPOLLIN;
+    watch.data.fd = listener;
+    ::epoll_ctl(poller, EPOLL_CTL_ADD, listener, &watch);
+    watch.data.fd = wakeup;
+    ::epoll_ctl(poller, EPOLL_CTL_ADD, wakeup, &watch);
+}
+
+basilio_server::~basilio_server() {
+    for (auto& entry : clients) { ::close(entry.first); }
+    clients.clear();
+    ::close(listener);
+    ::close(poller);
+    ::close(wakeup);
+}
+
+void basilio_server::main() {
+    epoll_event events[server_constants::max_events];
+    running = true;
+    
+    while (running) {
+        int ready = ::epoll_wait(poller, events, server_constants::max_events,
+                                 -1);
+        if (ready < 0) {
+            if (errno == EINTR) { continue; }
+            throw exception(error_string("epoll_wait failed"));
+        }
+        
+        for (int i = 0; i < ready; ++i) {
+            int fildes = events[i].data.fd;
+            if (fildes == listener) {
+                accept_clients();
+                continue;
+            } else if (fildes == wakeup) {
+                std::uint64_t count;
+                ::read(wakeup, &count, sizeof(count));
+                continue;
+            }
+            
+            /* it may have been dropped earlier in this round */
+            auto found = clients.find(fildes);
+            if (found == clients.end() || found->second->doomed) { continue; }
+            client& c = *found->second;
+            
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                read_from(c);
+            }
+            if ((events[i].events & EPOLLOUT) && !c.dirty) {
+                c.dirty = true;
+                dirty.push_back(&c);
+            }
+        }
+        
+        /* send everything this round produced, then say goodbye to whoever
+           left (which produces a little more) */
+        while (!dirty.empty() || !doomed.empty()) {
+            std::vector<client*> round;
+            round.swap(dirty);
+            for (client* c : round) {
+                c->dirty = false;
+                if (!c->doomed) { flush(*c); }
+            }
+            reap();
+        }
+    }
+}
+
+void basilio_server::stop() {
+    running = false;
+    std::uint64_t one = 1;
+    ::write(wakeup, &one, sizeof(one));
+}
+
+/*----------------------------------------------------------------------------*/
+
+void basilio_server::accept_clients() {
+    while (true) {
+        int fildes = ::accept4(listener, nullptr, nullptr,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fildes < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && debug) {
+                std::cerr << error_string("accept failed") << std::endl;
+            }
+            return;
+        }
+        
+        /* relayed packets are small and someone's waiting on each one */
+        int on = 1;
+        ::setsockopt(fildes, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        
+        epoll_event watch;
+        watch.events = EPOLLIN;
+        watch.data.fd = fildes;
+        if (::epoll_ctl(poller, EPOLL_CTL_ADD, fildes, &watch) != 0) {
+            ::close(fildes);
+            continue;
+        }
+        
+        /* ids only repeat after 65536 connections, by which time the
+           old owner's long gone */
+        clients.emplace(fildes, std::make_unique<client>(
+                fildes, static_cast<std::uint16_t>(counts.connections.load())));
+        ++counts.connections;
+        ++counts.clients;
+        if (debug) {
+            std::cerr << "connection on descriptor " << fildes << std::endl;
+        }
+    }
+}
+
+void basilio_server::read_from(client& c) {
+    try {
+        for (int i = 0; i < server_constants::read_budget; ++i) {
+            std::size_t got = c.inbound.fill();
+            while (std::optional<packet> pack = c.inbound.poll()) {
+                handle(c, *pack);
+                if (c.doomed) { return; }
+            }
+            if (got == 0) { return; } /* drained the socket */
+        }
+    } catch (transport::end_of_stream&) {
+        doom(c, "hung up");
+    } catch (transport::exception& exc) { /* including an oversized packet */
+        doom(c, exc.what());
+    } catch (std::bad_alloc&) {
+        doom(c, "ran the server out of memory");
+    }
+}
+
+void basilio_server::handle(client& c, const packet& pack) {
+    ++counts.packets_in;
+    if (c.closing) { return; }
+    
+    switch (pack.get_type()) {
+    case packet_type::join:
+        if (!c.joined) {
+            std::size_t length = pack.get_length();
+            if (length > server_constants::max_name_length) {
+                length = server_constants::max_name_length;
+            }
+            c.name.assign(pack.get_payload(), length);
+            c.joined = true;
+            announce("* " + c.name + " joined");
+        }
+        break;
+    case packet_type::disconnect:
+        c.closing = true;
+        if (!c.dirty) {
+            c.dirty = true;
+            dirty.push_back(&c);
+        }
+        break;
+    case packet_type::ping:
+        enqueue(c, encode(packet_type::ping, nullptr, 0, pack.get_payload(),
+                          pack.get_length()), true);
+        break;
+    case packet_type::plaintext:
+        if (c.joined) {
+            std::string prefix = c.name + ": ";
+            broadcast(encode(packet_type::plaintext, prefix.data(),
+                             prefix.length(), pack.get_payload(),
+                             pack.get_length()), &c, true);
+        }
+        break;
+    case packet_type::audio:
+        if (c.joined) {
+            unsigned char source[audio_source_length] = {
+                static_cast<unsigned char>(c.id),
+                static_cast<unsigned char>(c.id >> 8)
+            };
+            broadcast(encode(packet_type::audio,
+                             reinterpret_cast<const char*>(source),
+                             audio_source_length, pack.get_payload(),
+                             pack.get_length()),
+                      &c, false);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+basilio_server::shared_frame basilio_server::encode(
+        packet_type type, const char* prefix, std::size_t prefix_length,
+        const char* payload, std::size_t payload_length) {
+    /* a prefixed message might not fit any more; cut it short if so */
+    if (prefix_length + payload_length > max_payload_length) {
+        payload_length = max_payload_length - prefix_length;
+    }
+    std::size_t length = prefix_length + payload_length;
+    
+    shared_frame frame;
+    frame.buffer = frames.acquire(2 * header_length + length);
+    frame.type = type;
+    frame.payload_length = length;
+    
+    unsigned char* raw = reinterpret_cast<unsigned char*>(frame.buffer.data());
+    packet_size size = static_cast<packet_size>(length);
+    encode_header(packet_header { size, type, 0b0000'0001 }, raw);
+    encode_header(packet_header { size, type, 0 }, raw + header_length);
+    
+    char* body = frame.buffer.data() + 2 * header_length;
+    if (prefix_length != 0) { std::memcpy(body, prefix, prefix_length); }
+    if (payload_length != 0) {
+        std::memcpy(body + prefix_length, payload, payload_length);
+    }
+    return frame;
+}
+
+void basilio_server::broadcast(const shared_frame& frame, client* sender,
+                               bool echo) {
+    for (auto& entry : clients) {
+        client& c = *entry.second;
+        if (!c.joined) { continue; }
+        if (&c != sender) {
+            enqueue(c, frame, false);
+        } else if (echo) {
+            enqueue(c, frame, true);
+        }
+    }
+}
+
+void basilio_server::enqueue(client& c, const shared_frame& frame, bool self) {
+    if (c.doomed || c.closing) { return; }
+    
+    queued_frame q;
+    q.buffer = frame.buffer;
+    q.length = header_length + frame.payload_length;
+    q.droppable = frame.type == packet_type::audio;
+    char* raw = frame.buffer.data();
+    if (self) { /* the flagged header, then skip the plain one */
+        q.parts[0] = iovec { raw, header_length };
+        q.parts[1] = iovec { raw + 2 * header_length, frame.payload_length };
+        q.part_count = frame.payload_length != 0 ? 2 : 1;
+    } else {
+        q.parts[0] = iovec { raw + header_length, q.length };
+        q.part_count = 1;
+    }
+    
+    if (c.queued_bytes + q.length > send_limit) {
+        if (q.droppable) {
+            ++counts.dropped;
+            return;
+        }
+        
+        /* make room by throwing out voice that hasn't started going yet */
+        auto next = c.send_queue.begin();
+        if (c.front_sent != 0) { ++next; }
+        while (next != c.send_queue.end()
+               && c.queued_bytes + q.length > send_limit) {
+            if (next->droppable) {
+                c.queued_bytes -= next->length;
+                next = c.send_queue.erase(next);
+                ++counts.dropped;
+            } else {
+                ++next;
+            }
+        }
+        
+        if (c.queued_bytes + q.length > send_limit) {
+            ++counts.kicked;
+            doom(c, "fell too far behind");
+            return;
+        }
+    }
+    
+    c.queued_bytes += q.length;
+    c.send_queue.push_back(std::move(q));
+    ++counts.frames_out;
+    if (!c.dirty) {
+        c.dirty = true;
+        dirty.push_back(&c);
+    }
+}
+
+void basilio_server::flush(client& c) {
+    while (!c.send_queue.empty()) {
+        /* gather as much of the queue as one write can take */
+        scratch.clear();
+        std::size_t skip = c.front_sent;
+        std::size_t total = 0;
+        for (const queued_frame& q : c.send_queue) {
+            for (int i = 0; i < q.part_count; ++i) {
+                iovec part = q.parts[i];
+                if (skip >= part.iov_len) {
+                    skip -= part.iov_len;
+                    continue;
+                }
+                part.iov_base = static_cast<char*>(part.iov_base) + skip;
+                part.iov_len -= skip;
+                skip = 0;
+                scratch.push_back(part);
+                total += part.iov_len;
+            }
+            if (scratch.size() + 2 > IOV_MAX) { break; }
+        }
+        
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = scratch.data();
+        message.msg_iovlen = scratch.size();
+        ssize_t sent = ::sendmsg(c.fildes, &message, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                watch_writable(c, true);
+            } else {
+                doom(c, std::strerror(errno));
+            }
+            return;
+        }
+        ++counts.writes;
+        counts.bytes_out += sent;
+        
+        /* let go of whatever made it out */
+        std::size_t done = c.front_sent + static_cast<std::size_t>(sent);
+        while (!c.send_queue.empty() && done >= c.send_queue.front().length) {
+            done -= c.send_queue.front().length;
+            c.queued_bytes -= c.send_queue.front().length;
+            c.send_queue.pop_front();
+        }
+        c.front_sent = done;
+        
+        if (static_cast<std::size_t>(sent) < total) { /* socket's full */
+            watch_writable(c, true);
+            return;
+        }
+    }
+    
+    watch_writable(c, false);
+    if (c.closing) { doom(c, "said goodbye"); }
+}
+
+void basilio_server::watch_writable(client& c, bool on) {
+    if (c.writable_armed == on) { return; }
+    
+    epoll_event watch;
+    watch.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    watch.data.fd = c.fildes;
+    ::epoll_ctl(poller, EPOLL_CTL_MOD, c.fildes, &watch);
+    c.writable_armed = on;
+}
+
+void basilio_server::doom(client& c, const char* why) {
+    if (c.doomed) { return; }
+    c.doomed = true;
+    doomed.push_back(&c);
+    if (debug) {
+        std::cerr << "dropping descriptor " << c.fildes
+                  << (c.joined ? " (" + c.name + ")" : std::string())
+                  << ": " << why << std::endl;
+    }
+}
+
+void basilio_server::reap() {
+    std::vector<client*> round;
+    round.swap(doomed);
+    
+    for (client* c : round) {
+        int fildes = c->fildes;
+        bool was_joined = c->joined;
+        std::string name = std::move(c->name);
+        
+        ::epoll_ctl(poller, EPOLL_CTL_DEL, fildes, nullptr);
+        ::close(fildes);
+        clients.erase(fildes);
+        --counts.clients;
+        
+        if (was_joined) { announce("* " + name + " left"); }
+    }
+}
+
+void basilio_server::announce(const std::string& line) {
+    broadcast(encode(packet_type::plaintext, nullptr, 0, line.data(),
+                     line.length()), nullptr, false);
+}
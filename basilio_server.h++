@@ -0,0 +1,208 @@
+/**
+ * The other end of basilio_chat: a relay that passes every client's messages
+ * and voice on to everyone else in the room.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_SERVER_HXX
+#define BASILIO_SERVER_HXX
+
+#include "packet.h++"
+#include "framing.h++"
+#include "payload_pool.h++"
+#include "transport.h++"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace vanwestco {
+
+/**
+ * A single-threaded epoll reactor serving one room. Every socket is
+ * non-blocking; the only place the server waits is epoll_wait().
+ * 
+ * Each packet to be relayed is encoded exactly once, header and all, into a
+ * pooled reference-counted buffer, and every recipient's send queue holds a
+ * reference to that same buffer. Queues are flushed with gathered writes at
+ * the end of each round of events, so a burst of packets leaves in one
+ * system call per client.
+ * 
+ * Send queues are bounded by bytes. A client that can't keep up has voice
+ * dropped on the floor for it, and if it falls behind on anything else it's
+ * disconnected; either way nobody else has to wait for it.
+ * 
+ * How packets are handled:
+ *  join:       names the client and announces it to the room
+ *  disconnect: says goodbye, flushes, then closes
+ *  ping:       sent straight back to its sender, flagged is_self
+ *  plaintext:  prefixed with the sender's name and sent to everyone (the
+ *              sender's copy flagged is_self)
+ *  audio:      sent to everyone but the sender
+ * 
+ * @version 0
+ */
+class basilio_server {
+public:
+    /**
+     * Counters describing what the server has been up to. Safe to read from
+     * other threads while the server runs.
+     */
+    struct statistics {
+        std::atomic<unsigned long> connections{0};  /* accepted, ever */
+        std::atomic<unsigned long> clients{0};      /* connected now */
+        std::atomic<unsigned long> packets_in{0};   /* read from clients */
+        std::atomic<unsigned long> frames_out{0};   /* queued to clients */
+        std::atomic<unsigned long> bytes_out{0};    /* written to clients */
+        std::atomic<unsigned long> writes{0};       /* gathered writes made */
+        std::atomic<unsigned long> dropped{0};      /* voice frames dropped */
+        std::atomic<unsigned long> kicked{0};       /* slow clients cut off */
+    };
+    
+    /**
+     * Generic exception class for the server.
+     */
+    class exception : public std::exception {
+    public:
+        exception(const std::string&);
+        const char* what() const noexcept;
+    private:
+        std::string message;
+    };
+    
+    /**
+     * Opens a listening socket on the given port.
+     * 
+     * @param port the port to listen on
+     * @param send_limit the most bytes that may wait to go to one client
+     * @param debug whether to log connections to stderr
+     * 
+     * @throws basilio_server::exception if the socket can't be set up
+     */
+    basilio_server(const std::string& port,
+                   std::size_t send_limit = default_send_limit,
+                   bool debug = false);
+    
+    basilio_server(basilio_server&) = delete;
+    ~basilio_server();
+    
+    /**
+     * Serves clients until stop() is called.
+     * 
+     * @throws basilio_server::exception if epoll fails
+     */
+    void main();
+    
+    /**
+     * Makes main() return after its current round of events. May be called
+     * from any thread (or a signal handler).
+     */
+    void stop();
+    
+    /**
+     * @return the counters so far
+     */
+    const statistics& counters() const { return counts; }
+    
+    /**
+     * Default bound on each client's send queue.
+     */
+    static constexpr const std::size_t default_send_limit = 256 * 1024;
+private:
+    /**
+     * A packet encoded for sending, shared by every queue it's in. The buffer
+     * holds the header flagged is_self, then the plain header, then the
+     * payload, so the sender's copy and everyone else's differ only in which
+     * header they point at.
+     */
+    struct shared_frame {
+        payload_buffer buffer;
+        packet_type type;
+        std::size_t payload_length;
+    };
+    
+    /**
+     * One entry in a send queue.
+     */
+    struct queued_frame {
+        payload_buffer buffer;
+        iovec parts[2];
+        int part_count;
+        std::size_t length;
+        bool droppable;
+    };
+    
+    struct client {
+        int fildes;
+        std::uint16_t id;       /* goes in front of the voice it sends */
+        fd_transport link;
+        frame_reader inbound;
+        std::string name;
+        bool joined = false;
+        bool closing = false;   /* disconnect once the queue's flushed */
+        bool doomed = false;    /* disconnect at the end of this round */
+        bool dirty = false;     /* has something new to flush */
+        bool writable_armed = false;
+        
+        std::deque<queued_frame> send_queue;
+        std::size_t queued_bytes = 0;
+        std::size_t front_sent = 0; /* bytes of the front frame sent */
+        
+        client(int fildes, std::uint16_t id);
+    };
+    
+    void accept_clients();
+    void read_from(client& c);
+    void handle(client& c, const packet& pack);
+    
+    /**
+     * Encodes a packet once, ready for any number of queues.
+     */
+    shared_frame encode(packet_type type, const char* prefix,
+                        std::size_t prefix_length, const char* payload,
+                        std::size_t payload_length);
+    
+    /**
+     * Queues a frame to everyone who's joined, except (optionally) one
+     * client, who gets the is_self copy instead if echo is set.
+     */
+    void broadcast(const shared_frame& frame, client* sender, bool echo);
+    void enqueue(client& c, const shared_frame& frame, bool self);
+    
+    /**
+     * Writes as much of a client's queue as the socket will take.
+     */
+    void flush(client& c);
+    void watch_writable(client& c, bool on);
+    void doom(client& c, const char* why);
+    void reap();
+    void announce(const std::string& line);
+    
+    int listener;
+    int poller;
+    int wakeup;
+    std::size_t send_limit;
+    bool debug;
+    std::atomic<bool> running;
+    
+    std::unordered_map<int, std::unique_ptr<client>> clients;
+    std::vector<client*> dirty;
+    std::vector<client*> doomed;
+    std::vector<iovec> scratch;
+    payload_pool frames;
+    statistics counts;
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_SERVER_HXX */
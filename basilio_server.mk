@@ -0,0 +1,30 @@
+OBJECTS = basilio_server.o packet.o payload_pool.o transport.o framing.o
+
+# the server uses epoll, so it's Linux-only
+
+basilio_server: server_main.c++ $(OBJECTS)
+	c++ -O2 -o basilio_server server_main.c++ $(OBJECTS)
+
+basilio_server.o: basilio_server.c++ basilio_server.h++ packet.h++ \
+                  framing.h++ transport.h++ payload_pool.h++
+	c++ -O2 -c -o basilio_server.o basilio_server.c++
+
+packet.o: packet.c++ packet.h++ payload_pool.h++
+	c++ -O2 -c -o packet.o packet.c++
+
+payload_pool.o: payload_pool.c++ payload_pool.h++ packet.h++
+	c++ -O2 -c -o payload_pool.o payload_pool.c++
+
+transport.o: transport.c++ transport.h++
+	c++ -O2 -c -o transport.o transport.c++
+
+framing.o: framing.c++ framing.h++ packet.h++ payload_pool.h++ transport.h++
+	c++ -O2 -c -o framing.o framing.c++
+
+server_load: server_load.c++ packet.o payload_pool.o transport.o framing.o
+	c++ -O2 -o server_load server_load.c++ \
+	packet.o payload_pool.o transport.o framing.o
+
+.PHONY: clean
+clean:
+	-rm basilio_server server_load $(OBJECTS)
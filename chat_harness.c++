@@ -0,0 +1,402 @@
+/*-
+ * Runs the whole of basilio_chat with nothing real attached: the server is a
+ * thread on the far end of a socketpair that echoes like basilio_server, the
+ * sound card is a stream that records a tone burst every so often and listens
+ * for it coming back, and the keyboard is a pipe the harness types into.
+ * Reports how long typed lines take to come back onto the screen, how long
+ * voice takes from microphone to speaker, packets per second, and heap
+ * allocations per packet, followed by the client's own statistics.
+ * 
+ * usage: chat_harness [seconds] [lines/s] [--no-voice]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "basilio_chat.h++"
+#include "packet.h++"
+#include "framing.h++"
+#include "transport.h++"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+using Block_t = Audio_Handle::Block_t;
+
+/*----------------------------------------------------------------------------*
+ |                            allocation counting                             |
+ *----------------------------------------------------------------------------*/
+
+/* the harness's own threads turn this off so only the client gets counted */
+static thread_local bool count_allocations = true;
+static std::atomic<unsigned long> allocations{0};
+
+void* operator new(std::size_t size) {
+    if (count_allocations) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void* memory = std::malloc(size != 0 ? size : 1)) { return memory; }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+
+/*----------------------------------------------------------------------------*
+ |                                probe_stream                                |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * An Audio_Stream that records silence with a burst of tone every so many
+ * blocks, and watches what it's asked to play for those bursts. The time
+ * between a burst's first sample being "spoken" and it starting to play is
+ * the mouth-to-ear latency. Keeps to real time like a sound card would.
+ */
+class probe_stream : public Audio_Handle::Audio_Stream<Audio_Handle::sample_rate,
+                                                        Block_t> {
+public:
+    static constexpr const unsigned long burst_every = 32; /* ~350 ms */
+    static constexpr const int burst_amplitude = 12000;
+    static constexpr const int heard_threshold = 4000;
+    
+    Block_t record() override {
+        Clock_t::time_point now = wait_for_turn(record_start, recorded);
+        
+        Block_t block = Audio_Block_Pool<Block_t>::shared().acquire();
+        bool burst = (recorded - 1) % burst_every == 0;
+        double phase = 0;
+        for (auto& sample : block.channel()) {
+            sample = burst ? static_cast<Block_t::Sample_t>(
+                                     burst_amplitude * std::sin(phase))
+                           : 0;
+            phase += 2 * M_PI * 1000 / Audio_Handle::sample_rate;
+        }
+        
+        if (burst) { /* its first sample went in a block-length ago */
+            std::lock_guard<std::mutex> l(lock);
+            spoken.push_back(now - block_duration());
+        }
+        return block;
+    }
+    
+    void play(Block_t& block) override {
+        Clock_t::time_point now = wait_for_turn(play_start, played);
+        
+        int peak = 0;
+        for (auto sample : block.channel()) {
+            peak = std::max(peak, std::abs(static_cast<int>(sample)));
+        }
+        bool loud = peak > heard_threshold;
+        
+        /* only the start of a burst counts (concealment may echo it) */
+        if (loud && !was_loud) {
+            std::lock_guard<std::mutex> l(lock);
+            if (!spoken.empty()) {
+                latencies.push_back(std::chrono::duration<double, std::milli>(
+                        now - spoken.front()).count());
+                spoken.pop_front();
+            }
+        }
+        was_loud = loud;
+    }
+    
+    /**
+     * @return every mouth-to-ear latency measured, in milliseconds
+     */
+    std::vector<double> heard() {
+        std::lock_guard<std::mutex> l(lock);
+        return latencies;
+    }
+private:
+    static constexpr std::chrono::nanoseconds block_duration() {
+        return std::chrono::nanoseconds(1'000'000'000LL * Block_t::frames
+                                        / Audio_Handle::sample_rate);
+    }
+    
+    Clock_t::time_point wait_for_turn(Clock_t::time_point& start,
+                                      unsigned long& count) {
+        if (count == 0) {
+            start = Clock_t::now();
+        } else {
+            std::this_thread::sleep_until(start + count * block_duration());
+        }
+        ++count;
+        return Clock_t::now();
+    }
+    
+    Clock_t::time_point record_start;
+    Clock_t::time_point play_start;
+    unsigned long recorded = 0;
+    unsigned long played = 0;
+    bool was_loud = false;
+    
+    std::mutex lock;
+    std::deque<Clock_t::time_point> spoken;
+    std::vector<double> latencies;
+};
+
+/*----------------------------------------------------------------------------*
+ |                                stand-ins                                   |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Plays basilio_server for one client: announces joins, sends lines and pings
+ * back with is_self set, and sends voice straight back as though someone else
+ * had said it.
+ */
+static void serve(int fildes) {
+    count_allocations = false;
+    fd_transport link(fildes);
+    frame_reader inbound(link);
+    frame_writer outbound(link);
+    std::string name = "someone";
+    
+    try {
+        while (true) {
+            packet pack = inbound.next();
+            switch (pack.get_type()) {
+            case packet_type::join: {
+                name.assign(pack.get_payload(), pack.get_length());
+                std::string text = "* " + name + " joined";
+                outbound.write(packet(text.length(), packet_type::plaintext, 0,
+                                      text.data()));
+                break;
+            }
+            case packet_type::plaintext: {
+                std::string text = name + ": ";
+                text.append(pack.get_payload(), pack.get_length());
+                outbound.write(packet(text.length(), packet_type::plaintext, 1,
+                                      text.data()));
+                break;
+            }
+            case packet_type::ping:
+                outbound.write(packet(pack.get_length(), packet_type::ping, 1,
+                                      pack.get_payload()));
+                break;
+            case packet_type::audio: { /* as though from speaker 0 */
+                packet relayed(audio_source_length + pack.get_length(),
+                               packet_type::audio);
+                relayed[0] = 0;
+                relayed[1] = 0;
+                std::memcpy(&relayed[audio_source_length], pack.get_payload(),
+                            pack.get_length());
+                outbound.write(relayed);
+                break;
+            }
+            default:
+                break;
+            }
+        }
+    } catch (transport::exception&) {
+        /* the client hung up */
+    }
+}
+
+/**
+ * Watches what the client draws, noting when each line the harness typed
+ * shows up as a message (rather than as the input line being typed).
+ */
+static void watch_screen(int fildes, const std::string& marker,
+                         std::vector<Clock_t::time_point>& seen,
+                         std::mutex& seen_lock) {
+    count_allocations = false;
+    std::string pending;
+    char buffer[65536];
+    
+    ssize_t got;
+    while ((got = ::read(fildes, buffer, sizeof(buffer))) > 0) {
+        Clock_t::time_point now = Clock_t::now();
+        pending.append(buffer, got);
+        
+        std::size_t found;
+        while ((found = pending.find(marker)) != std::string::npos) {
+            std::size_t end = pending.find('.', found + marker.length());
+            if (end == std::string::npos) { break; }
+            
+            unsigned long n = std::strtoul(&pending[found + marker.length()],
+                                           nullptr, 10);
+            std::lock_guard<std::mutex> l(seen_lock);
+            if (n < seen.size()) { seen[n] = now; }
+            pending.erase(0, end);
+        }
+        
+        /* keep just enough to catch a marker split across reads */
+        if (pending.length() > 64) { pending.erase(0, pending.length() - 64); }
+    }
+}
+
+/**
+ * @return how many threads the process has right now
+ */
+static int count_threads() {
+    int count = 0;
+    if (DIR* tasks = ::opendir("/proc/self/task")) {
+        while (dirent* entry = ::readdir(tasks)) {
+            if (entry->d_name[0] != '.') { ++count; }
+        }
+        ::closedir(tasks);
+    }
+    return count;
+}
+
+static void report_latency(const char* name, std::vector<double> values) {
+    std::cout << name << ": ";
+    if (values.empty()) {
+        std::cout << "none measured" << std::endl;
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    auto percentile = [&values](double p) {
+        return values[std::min(values.size() - 1,
+                               static_cast<std::size_t>(values.size() * p))];
+    };
+    std::cout << std::fixed << std::setprecision(2)
+              << "n=" << values.size() << " p50 " << percentile(0.5)
+              << " ms, p99 " << percentile(0.99) << " ms, max "
+              << values.back() << " ms" << std::endl;
+}
+
+/*----------------------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 5;
+    double rate    = argc > 2 ? std::atof(argv[2]) : 20;
+    bool voice = !(argc > 3 && std::strcmp(argv[3], "--no-voice") == 0);
+    count_allocations = false;
+    
+    /* the network */
+    int link_ends[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, link_ends) != 0) {
+        std::perror("socketpair");
+        return 1;
+    }
+    
+    /* the keyboard: input_reader reads std::cin, so put a pipe under it */
+    int keyboard[2];
+    int screen[2];
+    if (::pipe(keyboard) != 0 || ::pipe(screen) != 0) {
+        std::perror("pipe");
+        return 1;
+    }
+    ::dup2(keyboard[0], 0);
+    ::close(keyboard[0]);
+    
+    /* the screen */
+    const std::string marker = "harness: line ";
+    long line_count = static_cast<long>(seconds * rate);
+    std::vector<Clock_t::time_point> typed(line_count);
+    std::vector<Clock_t::time_point> seen(line_count);
+    std::mutex seen_lock;
+    std::thread screen_watcher(watch_screen, screen[0], std::cref(marker),
+                               std::ref(seen), std::ref(seen_lock));
+    std::thread server(serve, link_ends[1]);
+    
+    probe_stream* probe = voice ? new probe_stream() : nullptr;
+    fd_transport client_link(link_ends[0]);
+    unsigned long packets = 0;
+    unsigned long allocated = 0;
+    int client_threads = 0;
+    double elapsed = 0;
+    std::vector<std::string> client_report;
+    std::vector<double> mouth_to_ear;
+    {
+        std::unique_ptr<Audio_Handle> audio;
+        if (voice) {
+            audio.reset(new Audio_Handle(std::unique_ptr<
+                    Audio_Handle::Audio_Stream<Audio_Handle::sample_rate,
+                                               Block_t>>(probe)));
+        }
+        basilio_chat chat(client_link, "harness", std::move(audio), screen[1]);
+        std::thread client([&chat] {
+            count_allocations = true;
+            chat.main();
+        });
+        
+        /* give everything a moment to settle before counting */
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        unsigned long packets_before = chat.counters().packets_sent.get()
+                                     + chat.counters().packets_received.get();
+        unsigned long allocated_before = allocations.load();
+        
+        Clock_t::time_point start = Clock_t::now();
+        auto interval = std::chrono::duration_cast<Clock_t::duration>(
+                std::chrono::duration<double>(1 / rate));
+        for (long i = 0; i < line_count; ++i) {
+            std::this_thread::sleep_until(start + i * interval);
+            std::string line = "line " + std::to_string(i) + ".\n";
+            typed[i] = Clock_t::now();
+            ::write(keyboard[1], line.data(), line.length());
+        }
+        std::this_thread::sleep_until(start + line_count * interval
+                                      + std::chrono::milliseconds(200));
+        
+        elapsed = std::chrono::duration<double>(Clock_t::now()
+                                                - start).count();
+        packets = chat.counters().packets_sent.get()
+                + chat.counters().packets_received.get() - packets_before;
+        allocated = allocations.load() - allocated_before;
+        client_report = chat.report();
+        
+        /* everything but this thread, the server and the screen watcher */
+        client_threads = count_threads() - 3;
+        
+        const char* finish = "/exit\n";
+        ::write(keyboard[1], finish, std::strlen(finish));
+        client.join();
+        if (voice) { mouth_to_ear = probe->heard(); }
+    }
+    
+    ::close(keyboard[1]);
+    ::close(screen[1]);
+    screen_watcher.join();
+    server.join();
+    ::close(link_ends[0]);
+    ::close(link_ends[1]);
+    ::close(screen[0]);
+    
+    /* report */
+    std::vector<double> round_trips;
+    for (long i = 0; i < line_count; ++i) {
+        if (seen[i] != Clock_t::time_point()) {
+            round_trips.push_back(std::chrono::duration<double, std::milli>(
+                    seen[i] - typed[i]).count());
+        }
+    }
+    
+    std::cout << line_count << " lines typed over " << std::setprecision(1)
+              << std::fixed << elapsed << " s"
+              << (voice ? ", voice on" : ", voice off") << std::endl;
+    report_latency("typed line back on screen", round_trips);
+    if (voice) { report_latency("mouth to ear", mouth_to_ear); }
+    std::cout << std::setprecision(0) << packets / elapsed << " packets/s, "
+              << std::setprecision(2)
+              << (packets != 0 ? static_cast<double>(allocated) / packets : 0)
+              << " allocations per packet (" << allocated
+              << " allocations, " << packets << " packets)" << std::endl;
+    std::cout << client_threads << " client threads" << std::endl;
+    for (const std::string& line : client_report) {
+        std::cout << line << std::endl;
+    }
+    
+    return round_trips.size() == static_cast<std::size_t>(line_count) ? 0 : 2;
+}
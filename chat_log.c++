@@ -0,0 +1,491 @@
+#include "chat_log.h++"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using chat_log = vanwestco::chat_log;
+
+/* how much each file grows by when it fills up */
+static constexpr const std::size_t records_chunk = 16 << 20;
+static constexpr const std::size_t text_chunk = 16 << 20;
+static constexpr const std::size_t times_chunk = 64 << 10;
+static constexpr const std::size_t postings_chunk = 16 << 20;
+
+/* the token table starts this big and doubles once it's half full */
+static constexpr const std::uint64_t initial_token_slots = 1 << 14;
+
+/* words shorter than this are too common to be worth indexing */
+static constexpr const std::size_t min_token_length = 2;
+
+/* the most words of a query that are checked */
+static constexpr const std::size_t max_query_tokens = 64;
+
+static constexpr const char log_magic[8] = { 'b', 'a', 's', 'i', 'l', 'o',
+                                             'g', '\0' };
+static constexpr const std::uint32_t log_version = 1;
+static constexpr const std::uint32_t no_block = ~std::uint32_t(0);
+
+struct chat_log::header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t records;      /* goes up last; the log ends here */
+    std::uint64_t text_length;
+    std::uint64_t blocks;       /* posting blocks handed out */
+    std::uint64_t tokens;       /* token table slots in use */
+    std::uint64_t token_slots;  /* always a power of two */
+    std::int64_t last_time;     /* us since the epoch */
+};
+
+struct chat_log::record {
+    std::int64_t time;          /* us since the epoch */
+    std::uint64_t offset;       /* of the sender, then the text, in text */
+    std::uint32_t length;       /* of the text */
+    std::uint16_t sender_length;
+    std::uint8_t type;
+    std::uint8_t self;
+};
+
+struct chat_log::token_slot {
+    std::uint64_t hash;         /* 0 for an empty slot */
+    std::uint32_t head;         /* newest block of postings */
+    std::uint32_t count;        /* messages posted */
+};
+
+struct chat_log::posting_block {
+    static constexpr const std::uint32_t capacity = 14;
+    
+    std::uint32_t next;         /* the older block, or no_block */
+    std::uint32_t used;
+    std::uint32_t records[capacity];
+};
+
+static std::string failure(const std::string& what) {
+    return what + ": " + std::strerror(errno);
+}
+
+/**
+ * Makes sure the log's directory exists, for the files in it.
+ * 
+ * @return the path of the named file in it
+ */
+static std::string log_file(const std::string& directory, const char* name) {
+    if (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        throw chat_log::exception(failure("couldn't make " + directory));
+    }
+    return directory + '/' + name;
+}
+
+/**
+ * Calls found(hash) with the hash of every word in some text long enough to
+ * index. Words are runs of ASCII letters and digits (and anything past
+ * ASCII, so UTF-8 words count too), folded to lower case.
+ */
+template <typename F>
+static void for_each_token(std::string_view text, F found) {
+    constexpr std::uint64_t basis = 14695981039346656037ull; /* FNV-1a */
+    constexpr std::uint64_t prime = 1099511628211ull;
+    std::uint64_t hash = basis;
+    std::size_t length = 0;
+    
+    auto finish = [&] {
+        if (length >= min_token_length) { found(hash != 0 ? hash : 1); }
+        hash = basis;
+        length = 0;
+    };
+    for (char next : text) {
+        unsigned char c = static_cast<unsigned char>(next);
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        } else if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+                     || c >= 0x80)) {
+            finish();
+            continue;
+        }
+        hash = (hash ^ c) * prime;
+        ++length;
+    }
+    finish();
+}
+
+static std::int64_t micros(chat_log::Clock_t::time_point when) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            when.time_since_epoch()).count();
+}
+
+/*----------------------------------------------------------------------------*/
+
+chat_log::chat_log(const std::string& directory)
+: lock(log_file(directory, "lock")),
+  records(log_file(directory, "records"), records_chunk),
+  text(log_file(directory, "text"), text_chunk),
+  times(log_file(directory, "times"), times_chunk),
+  tokens(log_file(directory, "tokens"),
+         initial_token_slots * sizeof(token_slot)),
+  postings(log_file(directory, "postings"), postings_chunk) {
+    /* the layout is on disk, so it mustn't drift between builds */
+    static_assert(sizeof(header) == 64, "log header layout");
+    static_assert(sizeof(record) == 24, "log record layout");
+    static_assert(sizeof(token_slot) == 16, "token slot layout");
+    static_assert(sizeof(posting_block) == 64, "posting block layout");
+    
+    header& h = head();
+    if (h.version == 0) { /* brand new */
+        std::memcpy(h.magic, log_magic, sizeof(log_magic));
+        h.version = log_version;
+        h.record_size = sizeof(record);
+        h.token_slots = initial_token_slots;
+    } else if (std::memcmp(h.magic, log_magic, sizeof(log_magic)) != 0
+               || h.version != log_version
+               || h.record_size != sizeof(record)) {
+        throw exception(directory + " isn't a chat log this can read");
+    }
+    
+    /* dying between renaming a grown token table into place and noting its
+       size here leaves the table bigger than the header says */
+    std::uint64_t table_slots = tokens.size() / sizeof(token_slot);
+    if (table_slots > h.token_slots && (table_slots & (table_slots - 1)) == 0) {
+        h.token_slots = table_slots;
+    }
+    
+    /* everything the header says is there had better be */
+    if (records.size() < sizeof(header) + h.records * sizeof(record)
+            || text.size() < h.text_length
+            || tokens.size() < h.token_slots * sizeof(token_slot)
+            || postings.size() < h.blocks * sizeof(posting_block)) {
+        throw exception(directory + " is damaged");
+    }
+}
+
+chat_log::~chat_log() { }
+
+void chat_log::append(Clock_t::time_point when, std::string_view sender,
+                      std::string_view message, packet_type type, bool self) {
+    std::uint64_t index = head().records;
+    if (index >= no_block) { throw exception("the log is full"); }
+    sender = sender.substr(0, UINT16_MAX);
+    message = message.substr(0, UINT32_MAX);
+    
+    /* make room first, since growing moves the mappings */
+    records.reserve(sizeof(header) + (index + 1) * sizeof(record));
+    text.reserve(head().text_length + sender.size() + message.size());
+    if (index % time_stride == 0) {
+        times.reserve((index / time_stride + 1) * sizeof(std::int64_t));
+    }
+    header& h = head();
+    
+    std::int64_t time = std::max(micros(when), h.last_time);
+    char* stored = text.data() + h.text_length;
+    std::memcpy(stored, sender.data(), sender.size());
+    std::memcpy(stored + sender.size(), message.data(), message.size());
+    
+    /* each word, once per message */
+    hashes.clear();
+    auto add = [this](std::uint64_t hash) { hashes.push_back(hash); };
+    for_each_token(sender, add);
+    for_each_token(message, add);
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    for (std::uint64_t hash : hashes) {
+        post(hash, static_cast<std::uint32_t>(index));
+    }
+    
+    if (index % time_stride == 0) {
+        reinterpret_cast<std::int64_t*>(times.data())[index / time_stride]
+                = time;
+    }
+    
+    record& r = *reinterpret_cast<record*>(records.data() + sizeof(header)
+                                           + index * sizeof(record));
+    r.time = time;
+    r.offset = h.text_length;
+    r.length = static_cast<std::uint32_t>(message.size());
+    r.sender_length = static_cast<std::uint16_t>(sender.size());
+    r.type = static_cast<std::uint8_t>(type);
+    r.self = self;
+    
+    h.text_length += sender.size() + message.size();
+    h.last_time = time;
+    h.records = index + 1;
+}
+
+std::uint64_t chat_log::size() const {
+    return head().records;
+}
+
+chat_log::entry chat_log::at(std::uint64_t index) const {
+    const record& r = record_at(index);
+    const char* stored = text.data() + r.offset;
+    return entry {
+        Clock_t::time_point(std::chrono::duration_cast<Clock_t::duration>(
+                std::chrono::microseconds(r.time))),
+        std::string_view(stored, r.sender_length),
+        std::string_view(stored + r.sender_length, r.length),
+        static_cast<packet_type>(r.type),
+        r.self != 0
+    };
+}
+
+std::uint64_t chat_log::find_time(Clock_t::time_point when) const {
+    std::int64_t time = micros(when);
+    std::uint64_t count = size();
+    
+    /* the first indexed record at or after the time; the one we want is
+       after the indexed record before it, and no later than it */
+    const std::int64_t* stamps = reinterpret_cast<const std::int64_t*>(
+            times.data());
+    std::uint64_t stamp_count = (count + time_stride - 1) / time_stride;
+    std::uint64_t k = std::lower_bound(stamps, stamps + stamp_count, time)
+                      - stamps;
+    if (k == 0) { return 0; }
+    
+    std::uint64_t low = (k - 1) * time_stride + 1;
+    std::uint64_t high = std::min(count, k * time_stride);
+    while (low < high) {
+        std::uint64_t middle = low + (high - low) / 2;
+        if (record_at(middle).time < time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+std::size_t chat_log::search(std::string_view query, std::size_t max,
+                             std::vector<std::uint64_t>& found) const {
+    std::vector<std::uint64_t> wanted;
+    for_each_token(query, [&wanted](std::uint64_t hash) {
+        wanted.push_back(hash);
+    });
+    std::sort(wanted.begin(), wanted.end());
+    wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+    if (wanted.size() > max_query_tokens) { wanted.resize(max_query_tokens); }
+    if (wanted.empty() || max == 0) { return 0; }
+    
+    /* walk the shortest list, checking each message for the other words */
+    const token_slot* rarest = nullptr;
+    for (std::uint64_t hash : wanted) {
+        const token_slot& slot = slot_for(hash);
+        if (slot.hash == 0) { return 0; } /* nothing has this word */
+        if (rarest == nullptr || slot.count < rarest->count) {
+            rarest = &slot;
+        }
+    }
+    
+    std::uint64_t count = size();
+    std::size_t taken = 0;
+    for (std::uint32_t next = rarest->head; next != no_block;
+         next = block_at(next).next) {
+        const posting_block& block = block_at(next);
+        for (std::uint32_t i = block.used; i-- > 0;) {
+            std::uint64_t index = block.records[i];
+            if (index < count && contains_all(index, wanted)) {
+                found.push_back(index);
+                if (++taken == max) { return taken; }
+            }
+        }
+    }
+    return taken;
+}
+
+void chat_log::sync() {
+    records.sync();
+    text.sync();
+    times.sync();
+    tokens.sync();
+    postings.sync();
+}
+
+/*----------------------------------------------------------------------------*/
+
+chat_log::header& chat_log::head() const {
+    return *reinterpret_cast<header*>(records.data());
+}
+
+const chat_log::record& chat_log::record_at(std::uint64_t index) const {
+    return *reinterpret_cast<const record*>(records.data() + sizeof(header)
+                                            + index * sizeof(record));
+}
+
+chat_log::token_slot* chat_log::slots() const {
+    return reinterpret_cast<token_slot*>(tokens.data());
+}
+
+chat_log::posting_block& chat_log::block_at(std::uint32_t index) const {
+    return reinterpret_cast<posting_block*>(postings.data())[index];
+}
+
+chat_log::token_slot& chat_log::slot_for(std::uint64_t hash) const {
+    std::uint64_t mask = head().token_slots - 1;
+    token_slot* table = slots();
+    std::uint64_t i = hash & mask;
+    while (table[i].hash != 0 && table[i].hash != hash) {
+        i = (i + 1) & mask;
+    }
+    return table[i];
+}
+
+void chat_log::post(std::uint64_t hash, std::uint32_t index) {
+    token_slot* slot = &slot_for(hash);
+    if (slot->hash == 0) { /* a new word */
+        if ((head().tokens + 1) * 2 > head().token_slots) {
+            grow_tokens();
+            slot = &slot_for(hash);
+        }
+        slot->hash = hash;
+        slot->head = no_block;
+        slot->count = 0;
+        ++head().tokens;
+    }
+    
+    if (slot->head == no_block
+            || block_at(slot->head).used == posting_block::capacity) {
+        std::uint32_t fresh = static_cast<std::uint32_t>(head().blocks);
+        postings.reserve((fresh + std::size_t(1)) * sizeof(posting_block));
+        posting_block& block = block_at(fresh);
+        block.next = slot->head;
+        block.used = 0;
+        slot->head = fresh;
+        ++head().blocks;
+    }
+    
+    posting_block& block = block_at(slot->head);
+    block.records[block.used++] = index;
+    ++slot->count;
+}
+
+void chat_log::grow_tokens() {
+    std::uint64_t old_slots = head().token_slots;
+    std::uint64_t new_slots = old_slots * 2;
+    
+    /* the old table stays as it is until the new one's whole */
+    std::string fresh_path = tokens.name() + ".new";
+    ::unlink(fresh_path.c_str()); /* left over from a crash, if it's there */
+    mapped_file fresh(fresh_path, new_slots * sizeof(token_slot));
+    
+    token_slot* table = reinterpret_cast<token_slot*>(fresh.data());
+    std::uint64_t mask = new_slots - 1;
+    for (std::uint64_t i = 0; i < old_slots; ++i) {
+        const token_slot& slot = slots()[i];
+        if (slot.hash == 0) { continue; }
+        std::uint64_t j = slot.hash & mask;
+        while (table[j].hash != 0) { j = (j + 1) & mask; }
+        table[j] = slot;
+    }
+    
+    /* then it goes in, and the header follows */
+    tokens.replace(fresh);
+    head().token_slots = new_slots;
+}
+
+bool chat_log::contains_all(std::uint64_t index,
+                            const std::vector<std::uint64_t>& wanted) const {
+    std::uint64_t seen = 0; /* a bit per wanted word */
+    auto check = [&wanted, &seen](std::uint64_t hash) {
+        auto found = std::lower_bound(wanted.begin(), wanted.end(), hash);
+        if (found != wanted.end() && *found == hash) {
+            seen |= std::uint64_t(1) << (found - wanted.begin());
+        }
+    };
+    
+    entry e = at(index);
+    for_each_token(e.sender, check);
+    for_each_token(e.text, check);
+    return seen == (wanted.size() == 64 ? ~std::uint64_t(0)
+                                        : (std::uint64_t(1) << wanted.size())
+                                          - 1);
+}
+
+/*----------------------------------------------------------------------------*/
+
+chat_log::file_lock::file_lock(const std::string& path)
+: fildes(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)) {
+    if (fildes < 0) { throw exception(failure("couldn't open " + path)); }
+    
+    if (::flock(fildes, LOCK_EX | LOCK_NB) != 0) {
+        std::string why = errno == EWOULDBLOCK
+                        ? path + " is held by another client"
+                        : failure("couldn't lock " + path);
+        ::close(fildes);
+        throw exception(why);
+    }
+}
+
+chat_log::file_lock::~file_lock() {
+    ::close(fildes);
+}
+
+/*----------------------------------------------------------------------------*/
+
+chat_log::mapped_file::mapped_file(const std::string& path, std::size_t chunk)
+: path(path), fildes(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600)),
+  base(nullptr), length(0), chunk(chunk) {
+    if (fildes < 0) { throw exception(failure("couldn't open " + path)); }
+    
+    struct stat status;
+    if (::fstat(fildes, &status) != 0) {
+        ::close(fildes);
+        throw exception(failure("couldn't look at " + path));
+    }
+    length = static_cast<std::size_t>(status.st_size);
+    if (length < chunk) {
+        if (::ftruncate(fildes, chunk) != 0) {
+            ::close(fildes);
+            throw exception(failure("couldn't make room in " + path));
+        }
+        length = chunk;
+    }
+    
+    void* mapped = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fildes, 0);
+    if (mapped == MAP_FAILED) {
+        ::close(fildes);
+        throw exception(failure("couldn't map " + path));
+    }
+    base = static_cast<char*>(mapped);
+}
+
+chat_log::mapped_file::~mapped_file() {
+    ::munmap(base, length);
+    ::close(fildes);
+}
+
+void chat_log::mapped_file::reserve(std::size_t needed) {
+    if (needed <= length) { return; }
+    resize((needed + chunk - 1) / chunk * chunk);
+}
+
+void chat_log::mapped_file::resize(std::size_t new_length) {
+    if (::ftruncate(fildes, new_length) != 0) {
+        throw exception(failure("couldn't grow " + path));
+    }
+    void* mapped = ::mremap(base, length, new_length, MREMAP_MAYMOVE);
+    if (mapped == MAP_FAILED) {
+        throw exception(failure("couldn't remap " + path));
+    }
+    base = static_cast<char*>(mapped);
+    length = new_length;
+}
+
+void chat_log::mapped_file::replace(mapped_file& fresh) {
+    if (::rename(fresh.path.c_str(), path.c_str()) != 0) {
+        throw exception(failure("couldn't replace " + path));
+    }
+    std::swap(fildes, fresh.fildes);
+    std::swap(base, fresh.base);
+    std::swap(length, fresh.length);
+}
+
+void chat_log::mapped_file::sync() {
+    ::msync(base, length, MS_SYNC);
+}
@@ -0,0 +1,259 @@
+/**
+ * An append-only history of the chat, kept on disk in memory-mapped files so
+ * logging a message is a handful of stores and looking back through millions
+ * of them only touches the pages it needs.
+ * 
+ * A log is a directory of six files:
+ * 
+ *   records   a header, then one fixed-size record per message (time,
+ *             offset of its text, lengths, type)
+ *   text      each message's sender and text, back to back
+ *   times     the time of every time_stride'th record, for finding a time
+ *             without binary searching the whole of records
+ *   tokens    an open-addressed hash table from a word's hash to its list of
+ *             messages
+ *   postings  those lists, as chains of small blocks, newest first
+ *   lock      empty; flock()ed by the one client that has the log open,
+ *             since the mappings are shared and two writers would trample
+ *             each other
+ * 
+ * The files grow a chunk at a time, so appending makes no system calls
+ * except when one fills up. The record count in the header goes up last, so
+ * a client that dies mid-append leaves a log that reads as though the last
+ * message never came; the index may point past the end, which searches
+ * ignore. The token table grows by building a bigger one in a file of its
+ * own and renaming it over the old one, so it's whole either way.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_CHAT_LOG_HXX
+#define BASILIO_CHAT_CHAT_LOG_HXX
+
+#include "packet.h++"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vanwestco {
+
+/*----------------------------------------------------------------------------*
+ |                                  chat_log                                  |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * The message history. Not thread-safe: whoever appends should also be the
+ * one reading.
+ * 
+ * @version 0
+ */
+class chat_log {
+public:
+    using Clock_t = std::chrono::system_clock;
+    
+    /**
+     * Thrown when the log can't be opened, is damaged, or can't grow.
+     */
+    class exception : public std::exception {
+    public:
+        exception(const std::string& ms) : message(ms) { }
+        const char* what() const noexcept override { return message.c_str(); }
+    private:
+        std::string message;
+    };
+    
+    /**
+     * One message, read back. The views point into the log and last until
+     * the next append().
+     */
+    struct entry {
+        Clock_t::time_point time;
+        std::string_view sender;
+        std::string_view text;
+        packet_type type;
+        bool self;
+    };
+    
+    /* how many records apart the times index's entries are */
+    static constexpr const std::uint64_t time_stride = 1024;
+    
+    /**
+     * Opens the log in a directory, creating both if they aren't there.
+     * 
+     * @param directory where the log lives
+     * 
+     * @throws exception if it can't be opened, isn't a log, or another
+     *         client has it open
+     */
+    explicit chat_log(const std::string& directory);
+    
+    chat_log(chat_log&) = delete;
+    
+    /**
+     * Closes the log. Everything appended is already in the page cache and
+     * reaches the disk whenever the kernel gets to it; sync() first to wait
+     * for that.
+     */
+    ~chat_log();
+    
+    /**
+     * Adds a message to the end of the log. Times earlier than the last
+     * message's (the clock was set back) are logged as the last message's.
+     * 
+     * @param when when it arrived
+     * @param sender who sent it (empty for server announcements)
+     * @param text what it said
+     * @param type the packet type it came in
+     * @param self whether it was our own, echoed back
+     * 
+     * @throws exception if the log has to grow and can't
+     */
+    void append(Clock_t::time_point when, std::string_view sender,
+                std::string_view text, packet_type type, bool self);
+    
+    /**
+     * @return the number of messages in the log
+     */
+    std::uint64_t size() const;
+    
+    /**
+     * @param index which message (0 is the oldest)
+     * @return the message
+     */
+    entry at(std::uint64_t index) const;
+    
+    /**
+     * Finds the first message at or after a time, using the times index to
+     * narrow the search to time_stride records.
+     * 
+     * @param when the time
+     * @return its index (size() if every message is older)
+     */
+    std::uint64_t find_time(Clock_t::time_point when) const;
+    
+    /**
+     * Finds the newest messages containing every word of a query (words are
+     * runs of letters and digits, compared without case; one-letter words
+     * match anything). Reads only the postings of the query's rarest word
+     * and the messages they name.
+     * 
+     * @param query the words
+     * @param max the most messages to find
+     * @param found where to put their indices, newest first (appended)
+     * @return the number found
+     */
+    std::size_t search(std::string_view query, std::size_t max,
+                       std::vector<std::uint64_t>& found) const;
+    
+    /**
+     * Writes everything appended so far out to disk.
+     */
+    void sync();
+private:
+    /**
+     * An exclusive flock() on a file, held for as long as this is around.
+     */
+    class file_lock {
+    public:
+        /**
+         * @throws exception if the file can't be opened or someone else
+         *         holds the lock
+         */
+        explicit file_lock(const std::string& path);
+        file_lock(file_lock&) = delete;
+        ~file_lock();
+    private:
+        int fildes;
+    };
+    
+    /**
+     * A file mapped into memory whole, growing a chunk at a time.
+     */
+    class mapped_file {
+    public:
+        mapped_file(const std::string& path, std::size_t chunk);
+        mapped_file(mapped_file&) = delete;
+        ~mapped_file();
+        
+        /**
+         * Makes the file (and the mapping) at least needed bytes long,
+         * rounding up to a whole chunk. Moves the mapping.
+         */
+        void reserve(std::size_t needed);
+        
+        /**
+         * Grows the file to exactly length bytes, zeroing anything new.
+         */
+        void resize(std::size_t length);
+        
+        /**
+         * Renames another mapped file over this one and takes its mapping,
+         * leaving the other with the old one to close. Anyone opening the
+         * path sees either file whole.
+         */
+        void replace(mapped_file& fresh);
+        
+        void sync();
+        
+        char* data() const { return base; }
+        std::size_t size() const { return length; }
+        const std::string& name() const { return path; }
+    private:
+        std::string path;
+        int fildes;
+        char* base;
+        std::size_t length;
+        std::size_t chunk;
+    };
+    
+    struct header;
+    struct record;
+    struct token_slot;
+    struct posting_block;
+    
+    header& head() const;
+    const record& record_at(std::uint64_t index) const;
+    token_slot* slots() const;
+    posting_block& block_at(std::uint32_t index) const;
+    
+    /**
+     * Finds a token's slot, or the empty slot it'd go in.
+     */
+    token_slot& slot_for(std::uint64_t hash) const;
+    
+    /**
+     * Adds a record to a token's postings.
+     */
+    void post(std::uint64_t hash, std::uint32_t index);
+    
+    /**
+     * Doubles the token table, rehashing everything in it into a new file
+     * that then replaces the old one.
+     */
+    void grow_tokens();
+    
+    /**
+     * @return whether a message has every one of the given token hashes
+     */
+    bool contains_all(std::uint64_t index,
+                      const std::vector<std::uint64_t>& hashes) const;
+    
+    file_lock lock;             /* taken before anything's mapped */
+    mapped_file records;
+    mapped_file text;
+    mapped_file times;
+    mapped_file tokens;
+    mapped_file postings;
+    
+    std::vector<std::uint64_t> hashes; /* append()'s scratch space */
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_CHAT_LOG_HXX */
@@ -0,0 +1,195 @@
+#include "framing.h++"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <limits.h>
+
+using frame_reader = vanwestco::frame_reader;
+using frame_writer = vanwestco::frame_writer;
+
+namespace framing_constants {
+/* one read can pull in this much; plenty for a burst of audio packets */
+static constexpr const std::size_t receive_chunk_size = 64 * 1024;
+static constexpr const std::size_t receive_chunk_preallocate = 4;
+static constexpr const std::size_t receive_chunk_max_free = 16;
+
+/* payloads this small cost less to copy in behind their headers than to
+   send as parts of their own */
+static constexpr const std::size_t copy_limit = 256;
+} /* ~namespace framing_constants */
+
+frame_reader::frame_reader(transport& source, std::size_t max_frame_length,
+                           payload_pool& chunks)
+: source(source), max_frame(max_frame_length), chunks(chunks), head(0),
+  tail(0) { }
+
+vanwestco::packet frame_reader::next() {
+    while (true) {
+        std::optional<packet> pack = poll();
+        if (pack) { return std::move(*pack); }
+        fill();
+    }
+}
+
+std::optional<vanwestco::packet> frame_reader::poll() {
+    packet_header head_fields;
+    if (!decode_head(head_fields)
+            || tail - head < header_length + head_fields.length) {
+        return std::nullopt;
+    }
+    
+    /* hand out a view into the chunk */
+    packet pack(head_fields.type, head_fields.info, chunk,
+                head + header_length, head_fields.length);
+    head += header_length + head_fields.length;
+    return pack;
+}
+
+std::size_t frame_reader::fill() {
+    make_room();
+    std::size_t got = source.read_some(chunk.data() + tail,
+                                       chunk.capacity() - tail);
+    tail += got;
+    return got;
+}
+
+vanwestco::payload_pool& frame_reader::receive_chunks() {
+    static payload_pool pool(framing_constants::receive_chunk_size,
+                             framing_constants::receive_chunk_preallocate,
+                             framing_constants::receive_chunk_max_free);
+    return pool;
+}
+
+bool frame_reader::decode_head(packet_header& fields) const {
+    if (tail - head < header_length) { return false; }
+    
+    if (!decode_header(reinterpret_cast<unsigned char*>(chunk.data() + head),
+                       fields)) {
+        throw transport::exception("malformed packet header");
+    }
+    /* checked before anyone sizes a chunk by it */
+    if (std::size_t(header_length) + fields.length > max_frame) {
+        throw transport::exception("packet too long ("
+                                   + std::to_string(fields.length)
+                                   + " bytes)");
+    }
+    return true;
+}
+
+void frame_reader::make_room() {
+    /* work out how big the frame at head is, as far as we know */
+    std::size_t needed = header_length;
+    packet_header head_fields;
+    if (decode_head(head_fields)) {
+        needed += head_fields.length;
+    }
+    
+    if (!chunk) {
+        chunk = chunks.acquire(std::max(needed, chunks.block_size()));
+        head = tail = 0;
+        return;
+    }
+    
+    /* nothing's looking at the chunk any more, so start over in place */
+    if (head == tail && chunk.unique()) {
+        head = tail = 0;
+    }
+    
+    if (chunk.capacity() - head >= needed && tail < chunk.capacity()) {
+        return;
+    }
+    
+    /* move the partial frame to a fresh chunk; everything before it stays
+       alive in the old one for as long as its packets do */
+    payload_buffer fresh = chunks.acquire(std::max(needed,
+                                                   chunks.block_size()));
+    if (tail != head) {
+        std::memcpy(fresh.data(), chunk.data() + head, tail - head);
+    }
+    tail -= head;
+    head = 0;
+    chunk = std::move(fresh);
+}
+
+/*----------------------------------------------------------------------------*/
+
+frame_writer::frame_writer(transport& sink) : sink(sink), next_part(0) { }
+
+void frame_writer::write(const packet& pack) {
+    write(&pack, 1);
+}
+
+void frame_writer::write(const packet* packs, std::size_t count) {
+    encode(packs, count);
+    sink.write_all(parts.data(), static_cast<int>(parts.size()));
+    next_part = parts.size();
+}
+
+bool frame_writer::write_some(const packet* packs, std::size_t count) {
+    encode(packs, count);
+    return flush();
+}
+
+bool frame_writer::flush() {
+    while (next_part < parts.size()) {
+        std::size_t done = sink.write_some(
+                &parts[next_part], static_cast<int>(std::min<std::size_t>(
+                        parts.size() - next_part, IOV_MAX)));
+        if (done == 0) { return false; } /* no room yet */
+        
+        /* skip past whatever made it out */
+        while (next_part < parts.size() && done >= parts[next_part].iov_len) {
+            done -= parts[next_part].iov_len;
+            ++next_part;
+        }
+        if (done > 0) {
+            iovec& partial = parts[next_part];
+            partial.iov_base = static_cast<char*>(partial.iov_base) + done;
+            partial.iov_len -= done;
+        }
+    }
+    return true;
+}
+
+void frame_writer::encode(const packet* packs, std::size_t count) {
+    /* headers, and small payloads along with them, go in staged first; it
+       mustn't move once parts point into it */
+    std::size_t staged_length = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        staged_length += header_length;
+        if (packs[i].get_length() <= framing_constants::copy_limit) {
+            staged_length += packs[i].get_length();
+        }
+    }
+    staged.resize(staged_length);
+    parts.clear();
+    next_part = 0;
+    
+    /* runs of staged bytes go out as one part; big payloads as their own */
+    unsigned char* next = staged.data();
+    unsigned char* run = next;
+    for (std::size_t i = 0; i < count; ++i) {
+        encode_header(packs[i].get_header(), next);
+        next += header_length;
+        
+        packet_size length = packs[i].get_length();
+        if (length <= framing_constants::copy_limit) {
+            if (length != 0) {
+                std::memcpy(next, packs[i].get_payload(), length);
+                next += length;
+            }
+        } else {
+            parts.push_back(iovec { run, std::size_t(next - run) });
+            parts.push_back(iovec {
+                const_cast<char*>(packs[i].get_payload()), length
+            });
+            run = next;
+        }
+    }
+    if (next != run) {
+        parts.push_back(iovec { run, std::size_t(next - run) });
+    }
+}
@@ -0,0 +1,220 @@
+/**
+ * Packet framing over a transport: buffered, zero-copy reads and gathered
+ * writes.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_FRAMING_HXX
+#define BASILIO_CHAT_FRAMING_HXX
+
+#include "packet.h++"
+#include "payload_pool.h++"
+#include "transport.h++"
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace vanwestco {
+
+/*----------------------------------------------------------------------------*
+ |                                frame_reader                                |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Splits a transport's byte stream into packets. Bytes are read into large
+ * pooled chunks, as many as the transport has ready at once, and every packet
+ * parsed out of a chunk is a view into it rather than a copy. A chunk goes back
+ * to its pool once the reader has moved on and the last packet looking into it
+ * is gone.
+ * 
+ * When a frame straddles the end of a chunk, only that partial frame is copied
+ * to the start of a fresh one. Frames bigger than a chunk get a chunk of their
+ * own, up to a limit: the length in a header is whatever the other end says it
+ * is, so a frame longer than that is refused as soon as its header is read,
+ * before anything is allocated for it.
+ * 
+ * Not thread-safe; use one reader per stream, from one thread at a time.
+ * 
+ * @version 0
+ */
+class frame_reader {
+public:
+    /**
+     * Constructs a reader over the given transport.
+     * 
+     * @param source the transport to read from
+     * @param max_frame_length the longest frame (header included) to accept
+     * @param chunks the pool to take receive chunks from
+     */
+    frame_reader(transport& source,
+                 std::size_t max_frame_length = header_length
+                                                + max_payload_length,
+                 payload_pool& chunks = frame_reader::receive_chunks());
+    
+    /**
+     * Returns the next packet, reading from the transport as needed.
+     * 
+     * Meant for blocking transports; with a non-blocking one, drive fill()
+     * and poll() yourself instead.
+     * 
+     * @return the packet
+     * 
+     * @throws transport::end_of_stream if the stream ends
+     * @throws transport::exception if a malformed or too-long header arrives
+     * @throws whatever the transport throws
+     */
+    packet next();
+    
+    /**
+     * Parses the next packet out of what's already been read, without touching
+     * the transport.
+     * 
+     * @return the packet, or nothing if a whole one isn't buffered yet
+     * 
+     * @throws transport::exception if a malformed or too-long header arrives
+     */
+    std::optional<packet> poll();
+    
+    /**
+     * Does one read from the transport into the receive buffer.
+     * 
+     * @return the number of bytes read (0 if a non-blocking transport had
+     *         nothing ready)
+     * 
+     * @throws transport::end_of_stream if the stream ends
+     * @throws transport::exception if a malformed or too-long header is
+     *         already buffered
+     * @throws whatever the transport throws
+     */
+    std::size_t fill();
+    
+    /**
+     * @return the number of bytes read but not yet handed out as packets
+     */
+    std::size_t buffered() const { return tail - head; }
+    
+    /**
+     * The pool receive chunks come from by default.
+     * 
+     * @return the pool
+     */
+    static payload_pool& receive_chunks();
+private:
+    /**
+     * Decodes the header of the frame starting at head, if it's all there.
+     * 
+     * @return whether it was
+     * 
+     * @throws transport::exception if it's malformed or the frame would be
+     *         longer than max_frame
+     */
+    bool decode_head(packet_header& fields) const;
+    
+    /**
+     * Makes sure the frame starting at head can fit in the current chunk,
+     * moving it to a new chunk if it can't.
+     */
+    void make_room();
+    
+    transport& source;
+    std::size_t max_frame;
+    payload_pool& chunks;
+    payload_buffer chunk;
+    std::size_t head; /* where the next unparsed frame starts */
+    std::size_t tail; /* where the read bytes end */
+};
+
+/*----------------------------------------------------------------------------*
+ |                                frame_writer                                |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Writes packets to a transport with gathered writes. Headers are encoded
+ * into a scratch buffer, along with any payload small enough that copying it
+ * is cheaper than another part, so a run of small packets goes out as one
+ * contiguous part; bigger payloads are parts of their own, pointing straight
+ * at the packet's buffer, and are never copied.
+ * 
+ * Over a non-blocking transport, write_some() sends what the transport will
+ * take and keeps its place in the rest, for flush() to carry on with once
+ * there's room.
+ * 
+ * Not thread-safe; use one writer per stream, from one thread at a time.
+ * 
+ * @version 0
+ */
+class frame_writer {
+public:
+    /**
+     * @param sink the transport to write to
+     */
+    explicit frame_writer(transport& sink);
+    
+    /**
+     * Writes a single packet.
+     * 
+     * @param pack the packet
+     * 
+     * @throws whatever the transport throws
+     */
+    void write(const packet& pack);
+    
+    /**
+     * Writes several packets, in order, in as few writes as the transport
+     * allows.
+     * 
+     * @param packs the packets
+     * @param count how many there are
+     * 
+     * @throws whatever the transport throws
+     */
+    void write(const packet* packs, std::size_t count);
+    
+    /**
+     * Starts writing several packets, in order, without waiting for the
+     * transport: whatever it won't take yet is left pending() for flush().
+     * The packets have to stay where they are, unchanged, until then.
+     * 
+     * @param packs the packets
+     * @param count how many there are
+     * @return whether all of them went out
+     * 
+     * @throws whatever the transport throws
+     */
+    bool write_some(const packet* packs, std::size_t count);
+    
+    /**
+     * Writes as much more of what write_some() left pending as the transport
+     * will take.
+     * 
+     * @return whether all of it has gone out now
+     * 
+     * @throws whatever the transport throws
+     */
+    bool flush();
+    
+    /**
+     * @return whether some of the last write_some() hasn't gone out yet
+     */
+    bool pending() const { return next_part < parts.size(); }
+private:
+    /**
+     * Sets parts up to point at the packets and their encoded headers (and
+     * the small payloads copied in behind them).
+     */
+    void encode(const packet* packs, std::size_t count);
+    
+    transport& sink;
+    std::vector<unsigned char> staged; /* scratch, reused between writes */
+    std::vector<iovec> parts;
+    std::size_t next_part; /* the first part not all written yet */
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_FRAMING_HXX */
@@ -0,0 +1,178 @@
+/*-
+ * Pushes voice and text at a sender whose link is slower than the voice
+ * alone, and measures how long each kind of packet waits before it's sent.
+ * Compares one FIFO for everything (the old outbound queue) against
+ * packet_lanes. The link is simulated by sleeping for as long as each write
+ * would take at the given rate.
+ * 
+ * usage: lanes_bench [link bytes/s] [seconds]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "packet_lanes.h++"
+#include "ring_queue.t++"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+
+static constexpr const std::size_t batch_size = 32;
+static constexpr const packet_size voice_length = 120; /* ~half-rate ADPCM */
+static constexpr const auto voice_interval = std::chrono::microseconds(10884);
+static constexpr const auto text_interval = std::chrono::milliseconds(100);
+
+/* every packet carries the time it was made in its first bytes */
+static packet stamped(packet_size length, packet_type type,
+                      Clock_t::time_point made) {
+    packet pack(length, type);
+    Clock_t::rep ticks = made.time_since_epoch().count();
+    std::memcpy(&pack[0], &ticks, sizeof(ticks));
+    return pack;
+}
+
+static Clock_t::time_point stamp_of(const packet& pack) {
+    Clock_t::rep ticks;
+    std::memcpy(&ticks, pack.get_payload(), sizeof(ticks));
+    return Clock_t::time_point(Clock_t::duration(ticks));
+}
+
+struct results {
+    std::vector<double> text_waits;  /* ms */
+    std::vector<double> voice_waits; /* ms */
+    unsigned long voice_made = 0;
+};
+
+static void report(const char* name, results& r, unsigned long dropped) {
+    auto summary = [](std::vector<double>& waits) {
+        std::sort(waits.begin(), waits.end());
+        auto at = [&waits](double p) {
+            return waits.empty() ? 0.0
+                    : waits[std::min(waits.size() - 1,
+                                     static_cast<std::size_t>(
+                                             waits.size() * p))];
+        };
+        std::cout << "p50 " << at(0.5) << " ms, p99 " << at(0.99)
+                  << " ms, max " << (waits.empty() ? 0 : waits.back())
+                  << " ms";
+    };
+    
+    std::cout << name << std::endl << std::fixed << std::setprecision(1)
+              << "  text:  ";
+    summary(r.text_waits);
+    std::cout << std::endl << "  voice: ";
+    summary(r.voice_waits);
+    std::cout << " (" << r.voice_waits.size() << " of " << r.voice_made
+              << " frames sent, " << dropped << " dropped)" << std::endl;
+}
+
+/**
+ * Runs producers against a sender for a while. push(pack, type, made) queues
+ * a packet; take(batch) waits briefly for packets and appends them.
+ */
+template <typename Push, typename Take>
+static results run(double link_rate, double seconds, Push push, Take take) {
+    results r;
+    std::atomic<bool> producing(true);
+    Clock_t::time_point start = Clock_t::now();
+    Clock_t::time_point finish = start
+            + std::chrono::duration_cast<Clock_t::duration>(
+                    std::chrono::duration<double>(seconds));
+    
+    std::thread voice([&] {
+        for (Clock_t::time_point next = start; next < finish;
+             next += voice_interval) {
+            std::this_thread::sleep_until(next);
+            push(stamped(voice_length, packet_type::audio, next),
+                 Clock_t::now());
+            ++r.voice_made;
+        }
+        producing = false;
+    });
+    std::thread text([&] {
+        for (Clock_t::time_point next = start; next < finish;
+             next += text_interval) {
+            std::this_thread::sleep_until(next);
+            push(stamped(24, packet_type::plaintext, next), Clock_t::now());
+        }
+    });
+    
+    /* the sender, over a link that takes its time */
+    std::vector<packet> batch;
+    while (producing || Clock_t::now() < finish) {
+        batch.clear();
+        take(batch);
+        
+        std::size_t bytes = 0;
+        Clock_t::time_point now = Clock_t::now();
+        for (const packet& pack : batch) {
+            bytes += header_length + pack.get_length();
+            double waited = std::chrono::duration<double, std::milli>(
+                    now - stamp_of(pack)).count();
+            (pack.get_type() == packet_type::audio ? r.voice_waits
+                                                   : r.text_waits)
+                    .push_back(waited);
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(
+                bytes / link_rate));
+    }
+    
+    voice.join();
+    text.join();
+    return r;
+}
+
+int main(int argc, char** argv) {
+    double link_rate = argc > 1 ? std::atof(argv[1]) : 8000;
+    double seconds   = argc > 2 ? std::atof(argv[2]) : 4;
+    
+    std::cout << "voice at " << (header_length + voice_length)
+                                * (1e6 / voice_interval.count())
+              << " bytes/s and a line of text every "
+              << text_interval.count() << " ms, over a " << link_rate
+              << " bytes/s link for " << seconds << " s" << std::endl;
+    
+    {
+        mpsc_queue<packet> fifo(256, overflow_policy::block);
+        results r = run(link_rate, seconds,
+                [&fifo](packet pack, Clock_t::time_point) {
+                    fifo.push(std::move(pack));
+                },
+                [&fifo](std::vector<packet>& batch) {
+                    fifo.wait_drain_for(std::back_inserter(batch), batch_size,
+                                        std::chrono::milliseconds(10));
+                });
+        report("one FIFO", r, 0);
+    }
+    
+    {
+        packet_lanes lanes(16, 256, 64, 24, std::chrono::milliseconds(150));
+        results r = run(link_rate, seconds,
+                [&lanes](packet pack, Clock_t::time_point made) {
+                    if (pack.get_type() == packet_type::audio) {
+                        lanes.push_voice(std::move(pack), made);
+                    } else {
+                        lanes.push(std::move(pack), lane::text);
+                    }
+                },
+                [&lanes](std::vector<packet>& batch) {
+                    lanes.wait_schedule(batch, batch_size,
+                                        std::chrono::milliseconds(10));
+                });
+        report("packet_lanes", r,
+               lanes.stale_voice() + lanes.overflowed_voice());
+    }
+    
+    return 0;
+}
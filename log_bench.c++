@@ -0,0 +1,232 @@
+/*-
+ * Builds a synthetic chat_log and times what the client does with one:
+ * appending, opening it cold (its pages dropped from the page cache first),
+ * searching it, and paging back through it from a point in time.
+ * 
+ * Messages are a few words each from a skewed vocabulary, so some words are
+ * in a good share of the log and most are rare; every 100,000th message also
+ * gets a word of its own to look for.
+ * 
+ * usage: log_bench [messages] [directory]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "chat_log.h++"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+
+static constexpr const char* const log_files[] = {
+    "records", "text", "times", "tokens", "postings"
+};
+
+static constexpr const std::size_t vocabulary_size = 20000;
+static constexpr const std::size_t message_pool_size = 1 << 18;
+static constexpr const unsigned long needle_every = 100000;
+static constexpr const std::size_t results_wanted = 20;
+static constexpr const int queries = 200;
+
+static double ms_since(Clock_t::time_point then) {
+    return std::chrono::duration<double, std::milli>(Clock_t::now()
+                                                     - then).count();
+}
+
+static void report(const char* name, std::vector<double>& times) {
+    std::sort(times.begin(), times.end());
+    auto at = [&times](double p) {
+        return times[std::min(times.size() - 1,
+                              static_cast<std::size_t>(times.size() * p))];
+    };
+    std::cout << std::fixed << std::setprecision(3) << "  " << name
+              << ": p50 " << at(0.5) << " ms, p99 " << at(0.99)
+              << " ms, max " << times.back() << " ms" << std::endl;
+}
+
+/**
+ * Writes a log's dirty pages out and drops them all from the page cache, so
+ * the next look at it has to go to the disk.
+ */
+static void drop_cached(const std::string& directory) {
+    for (const char* name : log_files) {
+        int fildes = ::open((directory + '/' + name).c_str(), O_RDONLY);
+        if (fildes < 0) { continue; }
+        ::fdatasync(fildes);
+        ::posix_fadvise(fildes, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fildes);
+    }
+}
+
+static unsigned long long disk_size(const std::string& directory) {
+    unsigned long long total = 0;
+    for (const char* name : log_files) {
+        struct stat status;
+        if (::stat((directory + '/' + name).c_str(), &status) == 0) {
+            total += static_cast<unsigned long long>(status.st_blocks) * 512;
+        }
+    }
+    return total;
+}
+
+int main(int argc, char** argv) {
+    unsigned long messages = argc > 1 ? std::strtoul(argv[1], nullptr, 10)
+                                      : 10000000;
+    std::string directory = argc > 2 ? argv[2] : "/tmp/log_bench";
+    for (const char* name : log_files) {
+        ::unlink((directory + '/' + name).c_str());
+    }
+    
+    /* a made-up language, and some things said in it */
+    std::mt19937_64 random(1);
+    std::vector<std::string> words;
+    const char* syllables[] = { "ba", "si", "lo", "ko", "ra", "te", "mu",
+                                "vin", "da", "pe", "gor", "xi", "lu", "nez" };
+    while (words.size() < vocabulary_size) {
+        std::string word;
+        int length = 1 + random() % 4;
+        for (int i = 0; i < length; ++i) { word += syllables[random() % 14]; }
+        words.push_back(word + std::to_string(words.size() % 97));
+    }
+    auto skewed_word = [&]() -> const std::string& {
+        double u = std::uniform_real_distribution<double>(0, 1)(random);
+        return words[static_cast<std::size_t>(vocabulary_size
+                                              * std::pow(u, 4))];
+    };
+    
+    std::vector<std::string> pool(message_pool_size);
+    for (std::string& said : pool) {
+        int length = 3 + random() % 12;
+        for (int i = 0; i < length; ++i) {
+            said.append(skewed_word()).push_back(i + 1 < length ? ' ' : '.');
+        }
+    }
+    std::vector<std::string> senders;
+    for (int i = 0; i < 50; ++i) {
+        senders.push_back("user" + std::to_string(i));
+    }
+    
+    std::cout << messages << " messages into " << directory << std::endl;
+    
+    { /* append */
+        chat_log log(directory);
+        chat_log::Clock_t::time_point when = chat_log::Clock_t::now()
+                - std::chrono::milliseconds(50) * messages;
+        std::string needle;
+        unsigned long long bytes = 0;
+        
+        Clock_t::time_point start = Clock_t::now();
+        for (unsigned long i = 0; i < messages; ++i) {
+            const std::string& said = pool[i % message_pool_size];
+            const std::string& sender = senders[i % senders.size()];
+            if (i % needle_every == 0) {
+                needle = said + " needle" + std::to_string(i / needle_every);
+                log.append(when, sender, needle, packet_type::plaintext, false);
+                bytes += sender.length() + needle.length();
+            } else {
+                log.append(when, sender, said, packet_type::plaintext, false);
+                bytes += sender.length() + said.length();
+            }
+            when += std::chrono::milliseconds(50);
+        }
+        double seconds = ms_since(start) / 1000;
+        std::cout << std::fixed << std::setprecision(0) << "append: "
+                  << messages / seconds << " messages/s, "
+                  << std::setprecision(1) << bytes / seconds / 1e6
+                  << " MB/s of text, " << disk_size(directory) / 1e6
+                  << " MB on disk" << std::endl;
+        
+        start = Clock_t::now();
+        log.sync();
+        std::cout << "sync: " << std::setprecision(0) << ms_since(start)
+                  << " ms" << std::endl;
+    }
+    
+    drop_cached(directory);
+    Clock_t::time_point start = Clock_t::now();
+    chat_log log(directory);
+    double open_time = ms_since(start);
+    
+    try { /* the first client holds the log; a second has to stay out */
+        chat_log second(directory);
+        std::cout << "second open: allowed (shouldn't be)" << std::endl;
+        return 1;
+    } catch (chat_log::exception& exc) {
+        std::cout << "second open: refused (" << exc.what() << ")"
+                  << std::endl;
+    }
+    
+    start = Clock_t::now();
+    std::vector<std::uint64_t> found;
+    log.search("needle" + std::to_string(messages / needle_every / 2),
+               results_wanted, found);
+    double first_search = ms_since(start);
+    
+    start = Clock_t::now();
+    std::uint64_t middle = log.find_time(log.at(log.size() / 2).time);
+    double first_seek = ms_since(start);
+    std::cout << std::setprecision(3) << "cold: open " << open_time
+              << " ms, first search " << first_search << " ms ("
+              << found.size() << " found), first seek " << first_seek
+              << " ms (to " << middle << ")" << std::endl;
+    
+    /* searches (a rare word, a common one, and a pair) and scrollback
+       (jump to a time and read a screenful), twice: first with the pages
+       still coming off the disk, then again with them cached */
+    unsigned long needles = (messages + needle_every - 1) / needle_every;
+    std::uint64_t characters = 0;
+    for (const char* pass : { "first pass", "second pass" }) {
+        std::mt19937_64 same(2);
+        std::vector<double> rare, common, pairs, seeks;
+        for (int i = 0; i < queries; ++i) {
+            std::string query = "needle" + std::to_string(same() % needles);
+            found.clear();
+            start = Clock_t::now();
+            log.search(query, results_wanted, found);
+            rare.push_back(ms_since(start));
+            
+            query = words[same() % 50];
+            found.clear();
+            start = Clock_t::now();
+            log.search(query, results_wanted, found);
+            common.push_back(ms_since(start));
+            
+            query = words[same() % 200] + " " + words[same() % 2000];
+            found.clear();
+            start = Clock_t::now();
+            log.search(query, results_wanted, found);
+            pairs.push_back(ms_since(start));
+            
+            chat_log::entry somewhere = log.at(same() % log.size());
+            start = Clock_t::now();
+            std::uint64_t first = log.find_time(somewhere.time);
+            for (std::uint64_t j = first;
+                 j < std::min(log.size(), first + results_wanted); ++j) {
+                characters += log.at(j).text.length();
+            }
+            seeks.push_back(ms_since(start));
+        }
+        
+        std::cout << pass << ", " << results_wanted << " results at most:"
+                  << std::endl;
+        report("search, rare word", rare);
+        report("search, common word", common);
+        report("search, two words", pairs);
+        report("seek and read a page", seeks);
+    }
+    return characters == 0;
+}
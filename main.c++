@@ -4,12 +4,14 @@
  * @author Charles Van West
  * @version 0
  */
- 
+
 #include "basilio_chat.h++"
-#include "../socket/Socket.h++"
+#include "transport.h++"
+#include "reactor.h++"
 
 #include <string>
 #include <sstream>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <exception>
@@ -21,8 +23,10 @@ struct arguments_object {
     std::string username;
     std::string host;
     std::string port;
+    std::string history;
     bool debug_mode_on = false;
     bool voice_on = false;
+    bool history_on = true;
 } arguments;
 
 namespace constants {
@@ -31,6 +35,11 @@ static constexpr const char* argument_format =
 
 static constexpr int key_debug = static_cast<int>('d');
 static constexpr int key_voice = 0x3001;
+static constexpr int key_history = 0x3002;
+static constexpr int key_no_history = 0x3003;
+
+/* under $HOME, unless --history says otherwise */
+static constexpr const char* default_history = ".basilio_chat_history";
 
 static constexpr error_t perr_generic_error = 0x2001;
 } /* ~namespace constants */
@@ -46,6 +55,11 @@ static const struct argp_option options[] = {
             "Turn debug mode on. You never know..." },
     { "voice", constants::key_voice, nullptr, 0,
             "Turn voice transmission/reception on." },
+    { "history", constants::key_history, "DIR", 0,
+            "Keep the chat history in DIR (~/.basilio_chat_history if not "
+            "given)." },
+    { "no-history", constants::key_no_history, nullptr, 0,
+            "Don't keep any history." },
     { nullptr }
 };
 
@@ -62,6 +76,12 @@ static error_t parse_function(int key, char* arg, argp_state* state) {
     case constants::key_voice:
         arguments->voice_on = true;
         break;
+    case constants::key_history:
+        arguments->history = arg;
+        break;
+    case constants::key_no_history:
+        arguments->history_on = false;
+        break;
     case ARGP_KEY_NO_ARGS:
         argp_usage(state);
         break;
@@ -119,20 +139,35 @@ int main(int argc, char** argv) {
                              nullptr, static_cast<void*>(&arguments));
     if (err != 0 || arguments.host.length() == 0) { return err; }
     
+    if (!arguments.history_on) {
+        arguments.history.clear();
+    } else if (arguments.history.empty() && std::getenv("HOME") != nullptr) {
+        arguments.history = std::string(std::getenv("HOME")) + '/'
+                            + constants::default_history;
+    }
+    
     basilio_chat program(arguments.host,
                          arguments.port,
                          arguments.username,
                          arguments.debug_mode_on,
-                         arguments.voice_on);
+                         arguments.voice_on,
+                         arguments.history);
     try {
         program.main();
-    } catch (socket::SocketException& ex) {
+    } catch (transport::exception& ex) {
         std::ostringstream error;
         error << argv[0]
-              << ": socket exception: "
+              << ": connection: "
               << ex.what();
         program.write_line(error.str());
         return 2;
+    } catch (reactor::exception& ex) {
+        std::ostringstream error;
+        error << argv[0]
+              << ": "
+              << ex.what();
+        program.write_line(error.str());
+        return 3;
     } catch (basilio_chat::exception& ex) {
         std::ostringstream error;
         error << argv[0]
@@ -1,43 +1,53 @@
-#include "basilio_chat.h++" /* for some reason, this doesn't compile if this
-                               header isn't first. I don't know why. */
 #include "packet.h++"
-#include "../socket/Socket.h++"
 
-#include <iostream>
-#include <string>
 #include <cstdint>
+#include <cstring>
+#include <utility>
 
-vanwestco::packet::packet(const packet_size l, const packet_type t, 
-                          const packet_bitfield inf) 
-        : length(l), type(t), info(inf) {
-    payload = new char[length];
+vanwestco::packet::packet(const packet_size l, const packet_type t,
+                          const packet_bitfield inf)
+        : length(l), type(t), info(inf),
+          buffer(payload_pool::packets().acquire(l)) {
+    payload = buffer.data();
 }
-    
-vanwestco::packet::packet(const packet_size l, const packet_type t, 
+
+vanwestco::packet::packet(const packet_size l, const packet_type t,
                           const packet_bitfield inf, const char* pl)
-        : length(l), type(t), info(inf) {
-    payload = new char[length];
-    for (int i = 0; i < length; ++i) { /* copy pl to payload */
-        payload[i] = pl[i];
+        : packet(l, t, inf) {
+    if (length != 0) { /* copy pl to payload */
+        std::memcpy(payload, pl, length);
     }
 }
-    
-vanwestco::packet::packet(const packet& pack) 
-        : length(pack.length), type(pack.type), info(pack.info) {
-    payload = new char[length];
-    for (int i = 0; i < length; ++i) {
-        payload[i] = pack.payload[i];
-    }
+
+vanwestco::packet::packet(const packet_type t, const packet_bitfield inf,
+                          payload_buffer buf, const std::size_t off,
+                          const packet_size l)
+        : length(l), type(t), info(inf), buffer(std::move(buf)) {
+    payload = buffer.data() + off;
 }
-    
-vanwestco::packet::packet(packet&& pack) 
-        : length(pack.length), type(pack.type), info(pack.info) {
-    payload = pack.payload;
+
+vanwestco::packet::packet(packet&& pack) noexcept
+        : length(pack.length), type(pack.type), info(pack.info),
+          buffer(std::move(pack.buffer)), payload(pack.payload) {
     pack.payload = nullptr;
     pack.length = 0;
     pack.type = packet_type::null_packet;
 }
 
+vanwestco::packet& vanwestco::packet::operator=(packet&& pack) noexcept {
+    if (this != &pack) {
+        length = pack.length;
+        type = pack.type;
+        info = pack.info;
+        buffer = std::move(pack.buffer);
+        payload = pack.payload;
+        pack.payload = nullptr;
+        pack.length = 0;
+        pack.type = packet_type::null_packet;
+    }
+    return *this;
+}
+
 vanwestco::packet_size vanwestco::packet::get_length() const {
     return length;
 }
@@ -54,6 +64,10 @@ const char* vanwestco::packet::get_payload() const {
     return payload;
 }
 
+const vanwestco::payload_buffer& vanwestco::packet::get_buffer() const {
+    return buffer;
+}
+
 char& vanwestco::packet::operator[](std::size_t index) {
     return payload[index];
 }
@@ -62,60 +76,42 @@ bool vanwestco::packet::is_self() const {
     return static_cast<bool>(info & 0b0000'0001);
 }
 
-vanwestco::packet::~packet() {
-    if (payload != nullptr) {
-        delete[] payload;
-    }
-}
-/*----------------------------------------------------------------------------*/
-vanwestco::packet vanwestco::read_packet(
-        const vanwestco::socket::Socket* sock) {
-    unsigned char header[header_length];
-    
-    /* get a header */
-    ssize_t read_bytes   /* XXX */
-            = sock->read(reinterpret_cast<char*>(header), header_length);
-    
-    /* build a packet from the header */
-    packet pack((static_cast<packet_size>(header[3]) << 24)
-              + (static_cast<packet_size>(header[2]) << 16)
-              + (static_cast<packet_size>(header[1]) << 8)
-              +  static_cast<packet_size>(header[0]),  /* reassembled length */
-                 static_cast<packet_type>(header[4]),  /* packet type */
-                 static_cast<packet_bitfield>(header[5])); /* is self */
-    pack.length -= 4; /* XXX */
-    
-    /* get the payload */
-    read_bytes += sock->read(pack.payload, pack.length);
-    if (read_bytes < pack.length + header_length - 4) { /* XXX */
-        throw vanwestco::basilio_chat::exception("EOF on packet stream");
-    }
-    
-    return pack;
+vanwestco::packet_header vanwestco::packet::get_header() const {
+    return packet_header { length, type, info };
 }
 
-void vanwestco::write_packet(const vanwestco::socket::Socket* sock, 
-                             const packet* pack) {
-    unsigned char raw_packet[header_length + pack->length];
-    packet_size sz_4 = pack->length + 4; /* XXX */
+/*----------------------------------------------------------------------------*/
+void vanwestco::encode_header(const packet_header& head, unsigned char* out) {
+    packet_size wire_length = head.length + header_length - length_field_size;
     
     /* add payload length to header */
-    raw_packet[3] = static_cast<char>(/*pack->length*/sz_4 >> 24);
-    raw_packet[2] = static_cast<char>((/*pack->length*/sz_4 >> 16) & 0xFF);
-    raw_packet[1] = static_cast<char>((/*pack->length*/sz_4 >> 8) & 0xFF);
-    raw_packet[0] = static_cast<char>(/*pack->length*/sz_4 & 0xFF);
+    out[3] = static_cast<unsigned char>(wire_length >> 24);
+    out[2] = static_cast<unsigned char>((wire_length >> 16) & 0xFF);
+    out[1] = static_cast<unsigned char>((wire_length >> 8) & 0xFF);
+    out[0] = static_cast<unsigned char>(wire_length & 0xFF);
     
     /* add type to header */
-    raw_packet[4] = static_cast<char>(pack->type);
+    out[4] = static_cast<unsigned char>(head.type);
     
     /* add is_self to header */
-    raw_packet[5] = pack->info;
+    out[5] = head.info;
     
-    /* copy the rest of the packet in */
-    for (int i = 0; i < pack->length; ++i) {
-        raw_packet[header_length + i] = pack->payload[i];
+    /* reserved */
+    out[6] = 0;
+    out[7] = 0;
+}
+
+bool vanwestco::decode_header(const unsigned char* in, packet_header& head) {
+    packet_size wire_length = (static_cast<packet_size>(in[3]) << 24)
+                            + (static_cast<packet_size>(in[2]) << 16)
+                            + (static_cast<packet_size>(in[1]) << 8)
+                            +  static_cast<packet_size>(in[0]);
+    if (wire_length < header_length - length_field_size) {
+        return false; /* too short to even cover the rest of the header */
     }
-                /* XXX */
-    sock->write(reinterpret_cast<char*>(raw_packet),
-                header_length + pack->length);
+    
+    head.length = wire_length - (header_length - length_field_size);
+    head.type = static_cast<packet_type>(in[4]);
+    head.info = static_cast<packet_bitfield>(in[5]);
+    return true;
 }
@@ -8,8 +8,9 @@
 #ifndef BASILIO_CHAT_PACKET_HXX
 #define BASILIO_CHAT_PACKET_HXX
 
-#include "../socket/Socket.h++"
+#include "payload_pool.h++"
 
+#include <cstddef>
 #include <cstdint>
 
 namespace vanwestco {
@@ -20,23 +21,29 @@ typedef uint8_t  packet_bitfield;  /* bitfield storage */
 const packet_size max_payload_length = 1024;
 const packet_size header_length = 8;
 
+/* the on-wire length counts everything after the length field itself */
+const packet_size length_field_size = sizeof(packet_size);
+
+/* audio the server relays starts with the speaker's id (16 bits,
+   little-endian), so listeners can keep everyone's frames apart */
+const packet_size audio_source_length = 2;
+
 enum class packet_type : uint8_t {
     null_packet = 0x00,  /* invalid type, technically */
     join        = 0x01,  /* sent on server join */
     disconnect  = 0x02,  /* sent on server disconnect */
     ping        = 0x03,  /* sent to ping client/server */
     plaintext   = 0x04,  /* indicates plaintext message */
-    audio       = 0x05,  /* audio data */
+    audio       = 0x05,  /* audio data (relayed after a source id) */
 };
 
-class packet; /* forward declaration */
-
 /**
- * For the following two functions, packet layout is done as follows:
+ * Decoded form of a packet header. On the wire, headers are laid out as
+ * follows:
  * ╔═════════════╦═══════════════════════════════════╗
  * ║ Header Byte ║            Description            ║
  * ╠═════════════╬═══════════════════════════════════╣
- * ║ 0 - 3       ║ Length of data                    ║
+ * ║ 0 - 3       ║ Length of data + 4 (little-endian)║
  * ╠═════════════╬═══════════════════════════════════╣
  * ║ 4           ║ Packet Type                       ║
  * ╠═════════════╬═══════════════════════════════════╣
@@ -64,27 +71,32 @@ class packet; /* forward declaration */
  * ╠═════════════╬═══════════════════════════════════╣
  * ║ 7           ║ Reserved                          ║
  * ╚═════════════╩═══════════════════════════════════╝
+ * 
+ * The length field counts bytes 4 - 7 of the header along with the payload,
+ * which is where the 4 comes from.
  */
+struct packet_header {
+    packet_size length;    /* payload length, not the on-wire value */
+    packet_type type;
+    packet_bitfield info;
+};
 
 /**
- * Reads a packet from the given socket.
+ * Writes a header in wire format.
  * 
- * @param sock the socket to read
- * 
- * @throws vanwestco::basilio_chat::exception if the end of stream happens
- * @throws vanwestco::socket::SocketException if something happens
+ * @param head the header to encode
+ * @param out where to put it (header_length bytes)
  */
-packet read_packet(const vanwestco::socket::Socket* sock);
+void encode_header(const packet_header& head, unsigned char* out);
 
 /**
- * Writes a packet to the given socket.
- * 
- * @param sock the socket to write to
- * @param pack the packet to write
+ * Reads a header in wire format.
  * 
- * @throws vanwestco::socket::SocketException if something happens
+ * @param in the raw header (header_length bytes)
+ * @param head where to put the decoded header
+ * @return false if the header is malformed
  */
-void write_packet(const vanwestco::socket::Socket* sock, const packet* pack);
+bool decode_header(const unsigned char* in, packet_header& head);
 
 /**
  * What a nice way to represent a packet, eh?
@@ -96,8 +108,8 @@ class packet {
 public:
     /**
      * Constructs a packet according length and type and (optionally) bitfield,
-     * initializing the internal payload to an empty array of the specified
-     * length.
+     * borrowing an uninitialized payload of the specified length from
+     * payload_pool::packets().
      * 
      * @param l the length of the payload
      * @param t the type of the packet
@@ -119,18 +131,36 @@ public:
            const packet_bitfield inf, const char* pl);
     
     /**
-     * Copies a packet. Not sure why you want this at the moment.
+     * Constructs a packet whose payload is a view into an existing buffer;
+     * nothing is copied. This is how frame_reader hands out packets.
+     * 
+     * @param t the type of the packet
+     * @param inf the info bitfield
+     * @param buf the buffer holding the payload
+     * @param off the offset of the payload within buf
+     * @param l the length of the payload
+     */
+    packet(const packet_type t, const packet_bitfield inf,
+           payload_buffer buf, const std::size_t off, const packet_size l);
+    
+    /**
+     * Copies a packet. The copy shares the original's payload, so this is
+     * cheap, but writing through operator[] shows up in both.
      * 
      * @param pack the packet to copy
      */
-    packet(const packet& pack); 
+    packet(const packet& pack) = default;
     
     /**
-     * Moves a packet. The old packet has all fields set to zero or nullptr.
+     * Moves a packet. The old packet is left with no payload, a length of zero
+     * and a type of null_packet.
      * 
      * @param pack the packet to move from
      */
-    packet(packet&& pack);
+    packet(packet&& pack) noexcept;
+    
+    packet& operator=(const packet& pack) = default;
+    packet& operator=(packet&& pack) noexcept;
     
     /**
      * @return the length of the packet
@@ -152,6 +182,11 @@ public:
      */
     const char* get_payload() const;
     
+    /**
+     * @return the buffer the payload lives in (for zero-copy sends)
+     */
+    const payload_buffer& get_buffer() const;
+    
     /**
      * @return the character at index <index>
      */
@@ -162,16 +197,19 @@ public:
      */
     bool is_self() const;
     
-    ~packet();
+    /**
+     * @return the packet's header, ready for encode_header()
+     */
+    packet_header get_header() const;
+    
+    ~packet() = default;
 
 private:
-    friend packet vanwestco::read_packet(const vanwestco::socket::Socket*);
-    friend void vanwestco::write_packet(const vanwestco::socket::Socket*,
-                                        const packet*);
     packet_size length;
     packet_type type;
     packet_bitfield info; /* currently used as a block bool for is_self */
-    char* payload;
+    payload_buffer buffer;
+    char* payload; /* points into buffer */
 };
 
 } /* ~namespace vanwestco */
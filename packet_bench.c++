@@ -0,0 +1,232 @@
+/*-
+ * Packets-per-second microbenchmark over a socketpair, comparing the old
+ * read_packet/write_packet approach (two reads and a new[] per packet, a
+ * byte-by-byte copy per write) against frame_reader/frame_writer. Then
+ * checks that a frame claiming to be far too long is refused as soon as its
+ * header arrives, without the reader allocating room for it.
+ * 
+ * usage: packet_bench [packet count] [payload length]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "packet.h++"
+#include "framing.h++"
+#include "transport.h++"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace vanwestco;
+
+namespace legacy { /* the old way, over a raw descriptor */
+static void read_exactly(int fildes, char* into, std::size_t length) {
+    while (length > 0) {
+        ssize_t got = ::read(fildes, into, length);
+        if (got <= 0) { std::exit(1); }
+        into += got;
+        length -= got;
+    }
+}
+
+static std::size_t read_packet(int fildes) {
+    unsigned char header[header_length];
+    read_exactly(fildes, reinterpret_cast<char*>(header), header_length);
+    
+    packet_header head;
+    decode_header(header, head);
+    char* payload = new char[head.length];
+    read_exactly(fildes, payload, head.length);
+    delete[] payload;
+    return head.length;
+}
+
+static void write_packet(int fildes, const char* payload, packet_size length) {
+    unsigned char raw_packet[header_length + length];
+    encode_header(packet_header { length, packet_type::plaintext, 0 },
+                  raw_packet);
+    for (packet_size i = 0; i < length; ++i) {
+        raw_packet[header_length + i] = payload[i];
+    }
+    
+    const unsigned char* next = raw_packet;
+    std::size_t left = header_length + length;
+    while (left > 0) {
+        ssize_t sent = ::write(fildes, next, left);
+        if (sent <= 0) { std::exit(1); }
+        next += sent;
+        left -= sent;
+    }
+}
+} /* ~namespace legacy */
+
+/**
+ * Runs a writer thread against a reader on the current thread and reports how
+ * fast packets got through.
+ */
+template<typename W, typename R>
+static void run(const char* name, long count, W writer, R reader) {
+    int ends[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+        std::cerr << "socketpair failed" << std::endl;
+        std::exit(1);
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    std::thread sender([&] { writer(ends[0]); });
+    std::size_t bytes = reader(ends[1]);
+    sender.join();
+    auto elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    
+    std::cout << name << ": "
+              << static_cast<long>(count / elapsed) << " packets/s, "
+              << bytes / elapsed / (1024 * 1024) << " MiB/s payload"
+              << std::endl;
+    
+    ::close(ends[0]);
+    ::close(ends[1]);
+}
+
+/**
+ * Sends a header claiming a payload of nearly 4 GiB, then some of it, and
+ * makes sure the reader throws instead of trying to buffer it.
+ * 
+ * @return whether it did
+ */
+static bool refuses_too_long() {
+    std::signal(SIGPIPE, SIG_IGN); /* the reader hangs up on the sender */
+    int ends[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) {
+        std::cerr << "socketpair failed" << std::endl;
+        std::exit(1);
+    }
+    
+    std::thread sender([&] {
+        unsigned char header[header_length];
+        encode_header(packet_header { 0xF0000000, packet_type::plaintext, 0 },
+                      header);
+        std::string junk(64 * 1024, 'x');
+        iovec parts[2] = {
+            iovec { header, header_length },
+            iovec { junk.data(), junk.size() }
+        };
+        fd_transport link(ends[0]);
+        try {
+            link.write_all(parts, 2);
+            for (int i = 0; i < 16; ++i) { link.write_all(parts + 1, 1); }
+        } catch (transport::exception&) { } /* the reader hung up */
+        ::shutdown(ends[0], SHUT_WR);
+    });
+    
+    rusage before, after;
+    ::getrusage(RUSAGE_SELF, &before);
+    bool refused = false;
+    try {
+        fd_transport link(ends[1]);
+        frame_reader in(link);
+        in.next();
+        std::cout << "too-long frame: accepted" << std::endl;
+    } catch (transport::end_of_stream&) {
+        std::cout << "too-long frame: read to the end of the stream"
+                  << std::endl;
+    } catch (transport::exception& exc) {
+        ::getrusage(RUSAGE_SELF, &after);
+        std::cout << "too-long frame: refused (" << exc.what() << "), max RSS "
+                  << before.ru_maxrss << " -> " << after.ru_maxrss << " KiB"
+                  << std::endl;
+        refused = true;
+    }
+    ::shutdown(ends[1], SHUT_RDWR);
+    sender.join();
+    
+    ::close(ends[0]);
+    ::close(ends[1]);
+    return refused;
+}
+
+int main(int argc, char** argv) {
+    long count = argc > 1 ? std::atol(argv[1]) : 1'000'000;
+    packet_size length = argc > 2 ? std::atol(argv[2]) : 64;
+    
+    std::string text(length, 'x');
+    std::cout << count << " packets of " << length << " bytes" << std::endl;
+    
+    run("before (read_packet/write_packet)", count,
+        [&](int fildes) {
+            for (long i = 0; i < count; ++i) {
+                legacy::write_packet(fildes, text.data(), length);
+            }
+        },
+        [&](int fildes) {
+            std::size_t bytes = 0;
+            for (long i = 0; i < count; ++i) {
+                bytes += legacy::read_packet(fildes);
+            }
+            return bytes;
+        });
+    
+    /* a system call per packet on the sending side, as before; small
+       payloads are copied in behind their headers, so that's one part per
+       write, as before, and one read on the other side for many packets */
+    run("after (frame_writer/frame_reader, one at a time)", count,
+        [&](int fildes) {
+            fd_transport link(fildes);
+            frame_writer out(link);
+            packet pack(length, packet_type::plaintext, 0, text.data());
+            for (long i = 0; i < count; ++i) {
+                out.write(pack);
+            }
+        },
+        [&](int fildes) {
+            fd_transport link(fildes);
+            frame_reader in(link, header_length + length);
+            std::size_t bytes = 0;
+            for (long i = 0; i < count; ++i) {
+                bytes += in.next().get_length();
+            }
+            return bytes;
+        });
+    
+    run("after (frame_writer/frame_reader, batches of 32)", count,
+        [&](int fildes) {
+            fd_transport link(fildes);
+            frame_writer out(link);
+            packet pack(length, packet_type::plaintext, 0, text.data());
+            packet batch[32] = {
+                pack, pack, pack, pack, pack, pack, pack, pack,
+                pack, pack, pack, pack, pack, pack, pack, pack,
+                pack, pack, pack, pack, pack, pack, pack, pack,
+                pack, pack, pack, pack, pack, pack, pack, pack
+            };
+            long i = 0;
+            for (; i + 32 <= count; i += 32) {
+                out.write(batch, 32);
+            }
+            for (; i < count; ++i) {
+                out.write(pack);
+            }
+        },
+        [&](int fildes) {
+            fd_transport link(fildes);
+            frame_reader in(link, header_length + length);
+            std::size_t bytes = 0;
+            for (long i = 0; i < count; ++i) {
+                bytes += in.next().get_length();
+            }
+            return bytes;
+        });
+    
+    return refuses_too_long() ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+#include "packet_lanes.h++"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+using packet_lanes = vanwestco::packet_lanes;
+using lane = vanwestco::lane;
+
+packet_lanes::packet_lanes(std::size_t control_capacity,
+                           std::size_t text_capacity,
+                           std::size_t voice_capacity,
+                           std::size_t text_share,
+                           Clock_t::duration voice_deadline)
+: control(control_capacity, overflow_policy::block),
+  text(text_capacity, overflow_policy::block),
+  voice(voice_capacity, overflow_policy::drop_oldest),
+  text_share(text_share), deadline(voice_deadline.count()) {
+    voice_batch.reserve(voice.capacity());
+}
+
+void packet_lanes::push(packet pack, lane which) {
+    if (which == lane::control) {
+        control.push(std::move(pack));
+    } else {
+        text.push(std::move(pack));
+    }
+    ready.notify();
+}
+
+void packet_lanes::push_voice(packet frame, Clock_t::time_point captured) {
+    if (voice.size_approx() >= voice.capacity()) { overflowed.add(); }
+    voice.push(voice_frame { std::move(frame), captured });
+    ready.notify();
+}
+
+bool packet_lanes::full(lane which) const {
+    if (which == lane::control) {
+        return control.size_approx() >= control.capacity();
+    } else {
+        return text.size_approx() >= text.capacity();
+    }
+}
+
+std::size_t packet_lanes::wait_schedule(std::vector<packet>& batch,
+                                        std::size_t max,
+                                        Clock_t::duration timeout) {
+    if (!ready.wait_for([this] { return anything_queued(); }, timeout)) {
+        return 0;
+    }
+    return schedule(batch, max);
+}
+
+std::size_t packet_lanes::schedule(std::vector<packet>& batch,
+                                   std::size_t max) {
+    /* control always goes first, then text up to its share */
+    std::size_t taken = control.drain(std::back_inserter(batch), max);
+    taken += text.drain(std::back_inserter(batch),
+                        std::min(text_share, max - taken));
+    
+    /* then voice, skipping whatever's gone stale (and taking more in its
+       place, so a round of nothing but stale frames doesn't come back empty
+       while there's fresh voice behind them) */
+    Clock_t::time_point oldest_useful = Clock_t::now() - voice_deadline();
+    while (taken < max) {
+        voice_batch.clear();
+        if (voice.drain(std::back_inserter(voice_batch), max - taken) == 0) {
+            break;
+        }
+        for (voice_frame& waiting : voice_batch) {
+            if (waiting.captured < oldest_useful) {
+                stale.add();
+            } else {
+                batch.push_back(std::move(waiting.frame));
+                ++taken;
+            }
+        }
+    }
+    
+    /* and text can have whatever room voice didn't use */
+    taken += text.drain(std::back_inserter(batch), max - taken);
+    return taken;
+}
+
+void packet_lanes::set_voice_deadline(Clock_t::duration new_deadline) {
+    deadline.store(new_deadline.count(), std::memory_order_relaxed);
+}
+
+packet_lanes::Clock_t::duration packet_lanes::voice_deadline() const {
+    return Clock_t::duration(deadline.load(std::memory_order_relaxed));
+}
+
+std::size_t packet_lanes::size_approx() const {
+    return control.size_approx() + text.size_approx() + voice.size_approx();
+}
+
+/*----------------------------------------------------------------------------*/
+
+bool packet_lanes::anything_queued() const {
+    return !control.empty() || !text.empty() || !voice.empty();
+}
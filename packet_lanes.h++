@@ -0,0 +1,170 @@
+/**
+ * Outbound packet scheduling: separate queues for control, text and voice,
+ * drained into batches in priority order.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_PACKET_LANES_HXX
+#define BASILIO_CHAT_PACKET_LANES_HXX
+
+#include "packet.h++"
+#include "ring_queue.t++"
+#include "stats.h++"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vanwestco {
+
+/**
+ * Which queue a packet waits in.
+ */
+enum class lane {
+    control, /* pings and the like; always first */
+    text,    /* typed lines; ahead of voice, mostly */
+    voice    /* audio frames; dropped once they're too old to be worth it */
+};
+
+/**
+ * The queues packets wait in on their way to the server. Each batch the
+ * sender takes is filled strictly with control packets first, then with text
+ * up to its share of the batch, then with voice, then with any text left
+ * over; a burst of typing never waits behind queued audio, and a flood of it
+ * can't starve voice either. Voice frames that have waited longer than the
+ * voice deadline are thrown away rather than sent late, and when the voice
+ * lane is full the oldest frame makes room for the newest.
+ * 
+ * Any thread may push control packets; text and voice have one producer each.
+ * Only one thread may take batches.
+ * 
+ * @version 0
+ */
+class packet_lanes {
+public:
+    using Clock_t = std::chrono::steady_clock;
+    
+    /**
+     * Constructs empty lanes.
+     * 
+     * @param control_capacity the most control packets that can wait
+     * @param text_capacity the most lines of text that can wait
+     * @param voice_capacity the most voice frames that can wait
+     * @param text_share how much of each batch text gets before voice
+     * @param voice_deadline how long a voice frame may wait before it's
+     *                       dropped
+     */
+    packet_lanes(std::size_t control_capacity,
+                 std::size_t text_capacity,
+                 std::size_t voice_capacity,
+                 std::size_t text_share,
+                 Clock_t::duration voice_deadline);
+    
+    packet_lanes(packet_lanes&) = delete;
+    
+    /**
+     * Queues a control or text packet, waiting if its lane is full.
+     * 
+     * @param pack the packet
+     * @param which lane::control or lane::text
+     */
+    void push(packet pack, lane which);
+    
+    /**
+     * Queues a voice frame, dropping the oldest waiting frame if the lane is
+     * full.
+     * 
+     * @param frame the frame
+     * @param captured when its audio was recorded
+     */
+    void push_voice(packet frame, Clock_t::time_point captured);
+    
+    /**
+     * Whether push() would have to wait for room in a lane. Only trustworthy
+     * from the taker's thread when nobody else pushes to that lane; the loop
+     * uses it so it never waits on room only it can make.
+     * 
+     * @param which lane::control or lane::text
+     * @return whether the lane is full
+     */
+    bool full(lane which) const;
+    
+    /**
+     * Takes up to max packets in scheduling order without waiting: control
+     * first, then text up to its share of the batch, then voice that isn't
+     * stale yet, then whatever more text fits.
+     * 
+     * @param batch where to put the packets (appended)
+     * @param max the most to take (at least 1)
+     * @return the number taken (0 only if the lanes are empty, stale voice
+     *         aside)
+     */
+    std::size_t schedule(std::vector<packet>& batch, std::size_t max);
+    
+    /**
+     * Waits until something's queued or the timeout runs out, then takes up
+     * to max packets in scheduling order.
+     * 
+     * @param batch where to put the packets (appended)
+     * @param max the most to take (at least 1)
+     * @param timeout the longest to wait
+     * @return the number taken (0 if it timed out)
+     * @see schedule()
+     */
+    std::size_t wait_schedule(std::vector<packet>& batch, std::size_t max,
+                              Clock_t::duration timeout);
+    
+    /**
+     * Changes how long voice frames may wait.
+     * 
+     * @param deadline the new deadline
+     */
+    void set_voice_deadline(Clock_t::duration deadline);
+    
+    /**
+     * @return how long voice frames may wait
+     */
+    Clock_t::duration voice_deadline() const;
+    
+    /**
+     * @return roughly how many packets are waiting, all lanes together
+     */
+    std::size_t size_approx() const;
+    
+    /**
+     * @return how many voice frames were dropped for being too old
+     */
+    std::uint64_t stale_voice() const { return stale.get(); }
+    
+    /**
+     * @return how many voice frames were dropped to make room
+     */
+    std::uint64_t overflowed_voice() const { return overflowed.get(); }
+private:
+    struct voice_frame {
+        packet frame;
+        Clock_t::time_point captured;
+    };
+    
+    bool anything_queued() const;
+    
+    mpsc_queue<packet> control;
+    spsc_queue<packet> text;
+    spsc_queue<voice_frame> voice;
+    impl_::parking_spot ready;
+    
+    std::size_t text_share;
+    std::atomic<Clock_t::duration::rep> deadline;
+    std::vector<voice_frame> voice_batch; /* only the taker touches this */
+    
+    counter stale;
+    counter overflowed;
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_PACKET_LANES_HXX */
@@ -0,0 +1,151 @@
+#include "payload_pool.h++"
+#include "packet.h++"
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+using payload_buffer = vanwestco::payload_buffer;
+using payload_pool   = vanwestco::payload_pool;
+
+namespace pool_constants {
+/* big enough for any payload the protocol allows (voice frames included),
+   with room for a header */
+static constexpr const std::size_t packet_block_size
+    = vanwestco::header_length + vanwestco::max_payload_length;
+static constexpr const std::size_t packet_preallocate = 16;
+
+/* about as many as the outbound lanes and a busy read can hold at once */
+static constexpr const std::size_t packet_max_free = 512;
+} /* ~namespace pool_constants */
+
+payload_buffer::payload_buffer(const payload_buffer& other)
+: held(other.held) {
+    if (held != nullptr) {
+        held->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+payload_buffer::payload_buffer(payload_buffer&& other) noexcept
+: held(other.held) {
+    other.held = nullptr;
+}
+
+payload_buffer& payload_buffer::operator=(const payload_buffer& other) {
+    if (held != other.held) {
+        payload_buffer copy(other);
+        std::swap(held, copy.held);
+    }
+    return *this;
+}
+
+payload_buffer& payload_buffer::operator=(payload_buffer&& other) noexcept {
+    if (this != &other) {
+        drop();
+        held = other.held;
+        other.held = nullptr;
+    }
+    return *this;
+}
+
+payload_buffer::~payload_buffer() {
+    drop();
+}
+
+char* payload_buffer::data() const {
+    /* the data lives right after the bookkeeping */
+    return held == nullptr ? nullptr : reinterpret_cast<char*>(held + 1);
+}
+
+std::size_t payload_buffer::capacity() const {
+    return held == nullptr ? 0 : held->capacity;
+}
+
+bool payload_buffer::unique() const {
+    return held != nullptr
+        && held->references.load(std::memory_order_acquire) == 1;
+}
+
+void payload_buffer::drop() {
+    if (held == nullptr) { return; }
+    
+    if (held->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (held->owner != nullptr) {
+            held->owner->release(held);
+        } else {
+            held->~block();
+            ::operator delete(held);
+        }
+    }
+    held = nullptr;
+}
+
+/*----------------------------------------------------------------------------*/
+
+payload_pool::payload_pool(std::size_t block_size, std::size_t preallocate,
+                           std::size_t max_free)
+: size(block_size), max_free(std::max(max_free, preallocate)) {
+    free_blocks.reserve(preallocate);
+    for (std::size_t i = 0; i < preallocate; ++i) {
+        free_blocks.push_back(allocate(this, size));
+    }
+}
+
+payload_pool::~payload_pool() {
+    for (block* b : free_blocks) {
+        b->~block();
+        ::operator delete(b);
+    }
+}
+
+payload_buffer payload_pool::acquire(std::size_t minimum) {
+    if (minimum > size) { /* doesn't fit, so it's a one-off */
+        return payload_buffer(allocate(nullptr, minimum));
+    }
+    
+    block* next = nullptr; {
+        std::lock_guard l(free_lock);
+        if (!free_blocks.empty()) {
+            next = free_blocks.back();
+            free_blocks.pop_back();
+        }
+    }
+    
+    if (next == nullptr) { /* pool's dry; grow it */
+        next = allocate(this, size);
+    } else {
+        next->references.store(1, std::memory_order_relaxed);
+    }
+    return payload_buffer(next);
+}
+
+payload_pool& payload_pool::packets() {
+    static payload_pool pool(pool_constants::packet_block_size,
+                             pool_constants::packet_preallocate,
+                             pool_constants::packet_max_free);
+    return pool;
+}
+
+payload_pool::block* payload_pool::allocate(payload_pool* owner,
+                                            std::size_t capacity) {
+    void* memory = ::operator new(sizeof(block) + capacity);
+    block* b = new (memory) block;
+    b->references.store(1, std::memory_order_relaxed);
+    b->owner = owner;
+    b->capacity = capacity;
+    return b;
+}
+
+void payload_pool::release(block* b) {
+    {
+        std::lock_guard l(free_lock);
+        if (free_blocks.size() < max_free) {
+            free_blocks.push_back(b);
+            return;
+        }
+    }
+    
+    /* plenty spare already */
+    b->~block();
+    ::operator delete(b);
+}
@@ -0,0 +1,148 @@
+/**
+ * Pooled, reference-counted payload memory, so packets don't each need their
+ * own trip through new[] and delete[].
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_PAYLOAD_POOL_HXX
+#define BASILIO_CHAT_PAYLOAD_POOL_HXX
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace vanwestco {
+
+class payload_pool; /* forward declaration */
+
+/*----------------------------------------------------------------------------*
+ |                               payload_buffer                               |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * A shared handle on a block of payload memory. Copying the handle only bumps
+ * a reference count; the block goes back to its pool (or is freed, if it was
+ * too big for the pool) when the last handle lets go of it.
+ * 
+ * @version 0
+ */
+class payload_buffer {
+public:
+    /**
+     * Constructs an empty handle that holds nothing.
+     */
+    payload_buffer() : held(nullptr) { }
+    
+    payload_buffer(const payload_buffer& other);
+    payload_buffer(payload_buffer&& other) noexcept;
+    payload_buffer& operator=(const payload_buffer& other);
+    payload_buffer& operator=(payload_buffer&& other) noexcept;
+    ~payload_buffer();
+    
+    /**
+     * @return the start of the block, or nullptr if the handle is empty
+     */
+    char* data() const;
+    
+    /**
+     * @return the usable size of the block in bytes
+     */
+    std::size_t capacity() const;
+    
+    /**
+     * @return whether this is the only handle on the block
+     */
+    bool unique() const;
+    
+    /**
+     * @return whether the handle holds a block
+     */
+    explicit operator bool() const { return held != nullptr; }
+private:
+    friend class payload_pool;
+    
+    /**
+     * Bookkeeping stored directly in front of the block's data, so each block
+     * is a single allocation.
+     */
+    struct block {
+        std::atomic<int> references;
+        payload_pool* owner; /* nullptr if not pooled */
+        std::size_t capacity;
+    };
+    
+    explicit payload_buffer(block* b) : held(b) { }
+    void drop();
+    
+    block* held;
+};
+
+/*----------------------------------------------------------------------------*
+ |                                payload_pool                                |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * A free list of equally-sized payload blocks. Requests that don't fit in a
+ * block get a one-off allocation instead, which is freed rather than pooled,
+ * and blocks handed back once the free list is full are freed too, so a
+ * burst doesn't keep its memory forever. Safe to use from any number of
+ * threads.
+ * 
+ * The pool must outlive every buffer it hands out.
+ * 
+ * @version 0
+ */
+class payload_pool {
+public:
+    /**
+     * Constructs a pool of blocks of the given size.
+     * 
+     * @param block_size the size of each pooled block in bytes
+     * @param preallocate the number of blocks to allocate up front
+     * @param max_free the most blocks to keep on the free list
+     */
+    payload_pool(std::size_t block_size, std::size_t preallocate = 0,
+                 std::size_t max_free = 256);
+    
+    payload_pool(payload_pool&) = delete;
+    ~payload_pool();
+    
+    /**
+     * Hands out a buffer of at least the given size.
+     * 
+     * @param minimum the number of bytes needed
+     * @return the buffer
+     */
+    payload_buffer acquire(std::size_t minimum);
+    
+    /**
+     * @return the size of the pooled blocks
+     */
+    std::size_t block_size() const { return size; }
+    
+    /**
+     * The pool packet payloads are borrowed from by default.
+     * 
+     * @return the pool
+     */
+    static payload_pool& packets();
+private:
+    friend class payload_buffer;
+    
+    using block = payload_buffer::block;
+    
+    static block* allocate(payload_pool* owner, std::size_t capacity);
+    void release(block* b);
+    
+    const std::size_t size;
+    const std::size_t max_free;
+    std::mutex free_lock;
+    std::vector<block*> free_blocks;
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_PAYLOAD_POOL_HXX */
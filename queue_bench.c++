@@ -0,0 +1,110 @@
+/*-
+ * Contention benchmark for the outbound queue: 1 - 8 producer threads pushing
+ * into one consumer, comparing the old mutex-and-condvar queue against
+ * mpsc_queue (and spsc_queue for the single-producer case).
+ * 
+ * usage: queue_bench [elements per run]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "ring_queue.t++"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace vanwestco;
+
+/**
+ * The old sync_queue, more or less: a lock around everything.
+ */
+template <typename T>
+class locked_queue {
+public:
+    void push(const T& element) {
+        std::lock_guard l(lock);
+        elements.push(element);
+        sync.notify_one();
+    }
+    
+    T pop() {
+        std::unique_lock<std::mutex> l(lock);
+        sync.wait(l, [this] { return !elements.empty(); });
+        T element = elements.front();
+        elements.pop();
+        return element;
+    }
+private:
+    std::queue<T> elements;
+    std::mutex lock;
+    std::condition_variable sync;
+};
+
+/**
+ * Pushes total elements from the given number of producers into queue and
+ * pops them all on the current thread.
+ * 
+ * @return millions of elements per second
+ */
+template <typename Q, typename C>
+static double run(Q& queue, int producers, long total, C consume) {
+    long each = total / producers;
+    auto start = std::chrono::steady_clock::now();
+    
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, each] {
+            for (long i = 0; i < each; ++i) { queue.push(i); }
+        });
+    }
+    consume(queue, each * producers);
+    for (std::thread& t : threads) { t.join(); }
+    
+    auto elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    return each * producers / elapsed / 1e6;
+}
+
+int main(int argc, char** argv) {
+    long total = argc > 1 ? std::atol(argv[1]) : 4'000'000;
+    
+    auto pop_each = [](auto& queue, long count) {
+        for (long i = 0; i < count; ++i) { queue.pop(); }
+    };
+    auto drain_batches = [](auto& queue, long count) {
+        std::vector<long> batch;
+        batch.reserve(64);
+        while (count > 0) {
+            batch.clear();
+            count -= queue.wait_drain(std::back_inserter(batch), 64);
+        }
+    };
+    
+    std::cout << "producers  locked (M/s)  mpsc pop (M/s)  mpsc drain (M/s)"
+              << std::endl;
+    for (int producers = 1; producers <= 8; ++producers) {
+        locked_queue<long> locked;
+        mpsc_queue<long> popped(1024);
+        mpsc_queue<long> drained(1024);
+        
+        std::cout << "        " << producers
+                  << "  " << run(locked, producers, total, pop_each)
+                  << "  " << run(popped, producers, total, pop_each)
+                  << "  " << run(drained, producers, total, drain_batches)
+                  << std::endl;
+    }
+    
+    spsc_queue<long> single(1024);
+    std::cout << "spsc, 1 producer, drained: "
+              << run(single, 1, total, drain_batches) << " M/s" << std::endl;
+    
+    return 0;
+}
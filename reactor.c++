@@ -0,0 +1,249 @@
+#include "reactor.h++"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using reactor = vanwestco::reactor;
+using task_scope = vanwestco::task_scope;
+
+/* how many ready descriptors one epoll_wait() can report */
+static constexpr const int max_events = 64;
+
+reactor::reactor()
+: poller(::epoll_create1(EPOLL_CLOEXEC)),
+  wakeup(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  running(false), next_timer(0) {
+    if (poller < 0 || wakeup < 0) {
+        std::string reason = std::strerror(errno);
+        if (poller >= 0) { ::close(poller); }
+        if (wakeup >= 0) { ::close(wakeup); }
+        throw exception("couldn't set up event loop: " + reason);
+    }
+    
+    epoll_event watch_wakeup;
+    watch_wakeup.events = EPOLLIN;
+    watch_wakeup.data.fd = wakeup;
+    ::epoll_ctl(poller, EPOLL_CTL_ADD, wakeup, &watch_wakeup);
+}
+
+reactor::~reactor() {
+    ::close(poller);
+    ::close(wakeup);
+}
+
+void reactor::run() {
+    loop_thread = std::this_thread::get_id();
+    running = true;
+    epoll_event events[max_events];
+    
+    while (running) {
+        run_posted();
+        if (!running) { break; }
+        int timeout = run_timers();
+        
+        /* a timer may have posted something; that shouldn't wait */
+        {
+            std::lock_guard l(posted_lock);
+            if (!posted.empty()) { timeout = 0; }
+        }
+        
+        int ready = ::epoll_wait(poller, events, max_events, timeout);
+        for (int i = 0; i < ready && running; ++i) {
+            if (events[i].data.fd == wakeup) {
+                std::uint64_t count;
+                while (::read(wakeup, &count, sizeof(count)) > 0) { }
+                continue;
+            }
+            
+            auto found = handlers.find(events[i].data.fd);
+            if (found != handlers.end()) {
+                std::shared_ptr<event_handler> handler = found->second;
+                (*handler)(events[i].events);
+            }
+        }
+    }
+    
+    loop_thread = std::thread::id();
+}
+
+void reactor::stop() {
+    post([this] { running = false; });
+}
+
+void reactor::post(task work) {
+    bool first;
+    {
+        std::lock_guard l(posted_lock);
+        first = posted.empty();
+        posted.push_back(std::move(work));
+    }
+    
+    /* the loop takes everything at once, so only the first needs a wakeup
+       (and the loop can't be waiting if it's the one posting) */
+    if (first && !in_loop()) {
+        std::uint64_t one = 1;
+        while (::write(wakeup, &one, sizeof(one)) < 0 && errno == EINTR) { }
+    }
+}
+
+void reactor::watch(int fildes, std::uint32_t events, event_handler handler) {
+    epoll_event watch_event;
+    watch_event.events = events;
+    watch_event.data.fd = fildes;
+    if (::epoll_ctl(poller, EPOLL_CTL_ADD, fildes, &watch_event) != 0) {
+        throw exception(std::string("couldn't watch descriptor: ")
+                        += std::strerror(errno));
+    }
+    handlers[fildes] = std::make_shared<event_handler>(std::move(handler));
+}
+
+void reactor::rewatch(int fildes, std::uint32_t events) {
+    epoll_event watch_event;
+    watch_event.events = events;
+    watch_event.data.fd = fildes;
+    if (::epoll_ctl(poller, EPOLL_CTL_MOD, fildes, &watch_event) != 0) {
+        throw exception(std::string("couldn't rewatch descriptor: ")
+                        += std::strerror(errno));
+    }
+}
+
+void reactor::unwatch(int fildes) {
+    ::epoll_ctl(poller, EPOLL_CTL_DEL, fildes, nullptr);
+    handlers.erase(fildes);
+}
+
+reactor::timer_id reactor::at(Clock_t::time_point when, task work) {
+    timer_id timer(when, next_timer++);
+    timers.emplace(timer, std::move(work));
+    return timer;
+}
+
+void reactor::cancel(timer_id timer) {
+    timers.erase(timer);
+}
+
+/*----------------------------------------------------------------------------*/
+
+void reactor::run_posted() {
+    {
+        std::lock_guard l(posted_lock);
+        running_posted.swap(posted);
+    }
+    for (task& work : running_posted) {
+        work();
+    }
+    running_posted.clear();
+}
+
+int reactor::run_timers() {
+    Clock_t::time_point now = Clock_t::now();
+    while (running && !timers.empty() && timers.begin()->first.first <= now) {
+        auto due = timers.extract(timers.begin());
+        due.mapped()();
+    }
+    
+    if (!running) { return 0; }
+    if (timers.empty()) { return -1; }
+    
+    /* round up, or we'd wake a little early and spin until it's time */
+    auto wait = timers.begin()->first.first - Clock_t::now();
+    auto wait_ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+    return static_cast<int>(std::max<decltype(wait_ms)>(wait_ms, 0));
+}
+
+/*----------------------------------------------------------------------------*/
+
+task_scope::task_scope(reactor& loop)
+: owner(loop), parent(nullptr), is_cancelled(false) { }
+
+task_scope::task_scope(task_scope& parent)
+: owner(parent.owner), parent(&parent), is_cancelled(parent.is_cancelled) {
+    parent.children.push_back(this);
+}
+
+task_scope::~task_scope() {
+    cancel();
+    for (task_scope* child : children) { child->parent = nullptr; }
+    if (parent != nullptr) {
+        auto& siblings = parent->children;
+        siblings.erase(std::remove(siblings.begin(), siblings.end(), this),
+                       siblings.end());
+    }
+}
+
+void task_scope::watch(int fildes, std::uint32_t events,
+                       reactor::event_handler handler) {
+    if (is_cancelled) { return; }
+    owner.watch(fildes, events, std::move(handler));
+    watched.insert(fildes);
+}
+
+void task_scope::rewatch(int fildes, std::uint32_t events) {
+    if (watched.count(fildes) != 0) { owner.rewatch(fildes, events); }
+}
+
+void task_scope::unwatch(int fildes) {
+    if (watched.erase(fildes) != 0) { owner.unwatch(fildes); }
+}
+
+void task_scope::after(Clock_t::duration delay, reactor::task work) {
+    schedule(Clock_t::now() + delay, Clock_t::duration::zero(),
+             std::make_shared<reactor::task>(std::move(work)));
+}
+
+void task_scope::every(Clock_t::duration interval, reactor::task work) {
+    schedule(Clock_t::now() + interval, interval,
+             std::make_shared<reactor::task>(std::move(work)));
+}
+
+void task_scope::on_cancel(reactor::task cleanup) {
+    if (is_cancelled) { return; }
+    cleanups.push_back(std::move(cleanup));
+}
+
+void task_scope::cancel() {
+    if (is_cancelled) { return; }
+    is_cancelled = true;
+    
+    /* children go first (and may take themselves off the list as they do) */
+    std::vector<task_scope*> cancelling(children);
+    for (task_scope* child : cancelling) { child->cancel(); }
+    
+    for (int fildes : watched) { owner.unwatch(fildes); }
+    watched.clear();
+    for (const reactor::timer_id& timer : timers) { owner.cancel(timer); }
+    timers.clear();
+    
+    std::vector<reactor::task> cleaning(std::move(cleanups));
+    cleanups.clear();
+    for (auto cleanup = cleaning.rbegin(); cleanup != cleaning.rend();
+         ++cleanup) {
+        (*cleanup)();
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+
+void task_scope::schedule(Clock_t::time_point when, Clock_t::duration interval,
+                          std::shared_ptr<reactor::task> work) {
+    if (is_cancelled) { return; }
+    
+    auto timer = std::make_shared<reactor::timer_id>();
+    *timer = owner.at(when, [this, timer, when, interval, work] {
+        timers.erase(*timer);
+        
+        /* set up the next one first, so cancelling from work() catches it */
+        if (interval != Clock_t::duration::zero()) {
+            Clock_t::time_point next = when + interval;
+            Clock_t::time_point now = Clock_t::now();
+            schedule(next > now ? next : now + interval, interval, work);
+        }
+        (*work)();
+    });
+    timers.insert(*timer);
+}
@@ -0,0 +1,286 @@
+/**
+ * A single-threaded event loop: descriptor readiness through epoll, timers,
+ * and tasks handed over from other threads through an eventfd. task_scope
+ * groups what one part of the program has going on in the loop so it can all
+ * be called off at once.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_REACTOR_HXX
+#define BASILIO_CHAT_REACTOR_HXX
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace vanwestco {
+
+/*----------------------------------------------------------------------------*
+ |                                  reactor                                   |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Runs handlers for descriptor events, timers and posted tasks, one at a
+ * time, on whichever thread calls run(). Handlers should be quick; anything
+ * that blocks holds up everything else.
+ * 
+ * post() and stop() may be called from any thread. Everything else belongs
+ * to the loop thread (or to whoever's setting things up before run()).
+ * 
+ * @version 0
+ */
+class reactor {
+public:
+    using Clock_t = std::chrono::steady_clock;
+    using task = std::function<void()>;
+    using event_handler = std::function<void(std::uint32_t events)>;
+    
+    /**
+     * Names a pending timer, for cancelling it.
+     */
+    using timer_id = std::pair<Clock_t::time_point, std::uint64_t>;
+    
+    /**
+     * Thrown when the loop can't be set up or a descriptor can't be watched.
+     */
+    class exception : public std::exception {
+    public:
+        exception(const std::string& ms) : message(ms) { }
+        const char* what() const noexcept override { return message.c_str(); }
+    private:
+        std::string message;
+    };
+    
+    /**
+     * @throws exception if epoll or the eventfd can't be had
+     */
+    reactor();
+    
+    reactor(reactor&) = delete;
+    ~reactor();
+    
+    /**
+     * Runs handlers until stop() is called.
+     */
+    void run();
+    
+    /**
+     * Makes run() return once the handler it's in (if any) finishes. Safe
+     * from any thread.
+     */
+    void stop();
+    
+    /**
+     * Queues a task to run on the loop thread, waking the loop if it's
+     * waiting. Safe from any thread; tasks run in the order posted.
+     * 
+     * @param work the task
+     */
+    void post(task work);
+    
+    /**
+     * Calls handler with the epoll event mask whenever fildes is ready.
+     * 
+     * @param fildes the descriptor
+     * @param events what to watch for (EPOLLIN, EPOLLOUT...)
+     * @param handler what to call
+     * 
+     * @throws exception if epoll won't take the descriptor
+     */
+    void watch(int fildes, std::uint32_t events, event_handler handler);
+    
+    /**
+     * Changes what a watched descriptor is watched for, keeping its handler.
+     * 
+     * @param fildes the descriptor
+     * @param events what to watch for now
+     * 
+     * @throws exception if epoll won't take the change
+     */
+    void rewatch(int fildes, std::uint32_t events);
+    
+    /**
+     * Stops watching a descriptor. A handler may unwatch its own descriptor.
+     * 
+     * @param fildes the descriptor
+     */
+    void unwatch(int fildes);
+    
+    /**
+     * Runs a task at a given time (or as soon after as the loop gets to it).
+     * 
+     * @param when the time
+     * @param work the task
+     * @return the timer, for cancel()
+     */
+    timer_id at(Clock_t::time_point when, task work);
+    
+    /**
+     * Runs a task after a delay.
+     * 
+     * @see at()
+     */
+    timer_id after(Clock_t::duration delay, task work) {
+        return at(Clock_t::now() + delay, std::move(work));
+    }
+    
+    /**
+     * Calls off a timer. Does nothing if it's already gone off.
+     * 
+     * @param timer the timer
+     */
+    void cancel(timer_id timer);
+    
+    /**
+     * @return whether the calling thread is the one running the loop
+     */
+    bool in_loop() const { return std::this_thread::get_id() == loop_thread; }
+private:
+    /**
+     * Runs every posted task queued so far.
+     */
+    void run_posted();
+    
+    /**
+     * Runs every timer that's due.
+     * 
+     * @return how long until the next one (-1 for no timers), in ms
+     */
+    int run_timers();
+    
+    int poller;
+    int wakeup;  /* eventfd; written when there's something posted */
+    bool running;
+    std::atomic<std::thread::id> loop_thread;
+    
+    /* shared so a handler survives unwatching itself */
+    std::unordered_map<int, std::shared_ptr<event_handler>> handlers;
+    std::map<timer_id, task> timers;
+    std::uint64_t next_timer;
+    
+    std::mutex posted_lock;
+    std::vector<task> posted;
+    std::vector<task> running_posted; /* only the loop touches this */
+};
+
+/*----------------------------------------------------------------------------*
+ |                                 task_scope                                 |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Everything one part of the program has registered with a reactor: the
+ * descriptors it watches, its timers, its child scopes and whatever cleanup it
+ * wants done. cancel() takes all of it out of the loop, children first, and
+ * then runs the cleanup, newest first; destroying the scope cancels it. Once
+ * cancelled, a scope ignores anything new it's given.
+ * 
+ * Belongs to the loop thread, like the reactor's own watch() and at(); to
+ * cancel from elsewhere, post() a task that does it.
+ * 
+ * @version 0
+ */
+class task_scope {
+public:
+    using Clock_t = reactor::Clock_t;
+    
+    /**
+     * Makes a top-level scope.
+     * 
+     * @param loop the reactor things are registered with
+     */
+    explicit task_scope(reactor& loop);
+    
+    /**
+     * Makes a scope that's cancelled along with its parent.
+     * 
+     * @param parent the parent
+     */
+    explicit task_scope(task_scope& parent);
+    
+    ~task_scope();
+    
+    /**
+     * @see reactor::watch()
+     */
+    void watch(int fildes, std::uint32_t events,
+               reactor::event_handler handler);
+    
+    /**
+     * Changes what one of the scope's descriptors is watched for.
+     * 
+     * @see reactor::rewatch()
+     */
+    void rewatch(int fildes, std::uint32_t events);
+    
+    /**
+     * @see reactor::unwatch()
+     */
+    void unwatch(int fildes);
+    
+    /**
+     * Runs a task after a delay, unless the scope's cancelled first.
+     * 
+     * @param delay the delay
+     * @param work the task
+     */
+    void after(Clock_t::duration delay, reactor::task work);
+    
+    /**
+     * Runs a task every so often until the scope's cancelled.
+     * 
+     * @param interval how often
+     * @param work the task
+     */
+    void every(Clock_t::duration interval, reactor::task work);
+    
+    /**
+     * Adds something to do when the scope's cancelled.
+     * 
+     * @param cleanup what to do
+     */
+    void on_cancel(reactor::task cleanup);
+    
+    /**
+     * Cancels the scope and its children. Safe to call more than once, and
+     * from inside the scope's own handlers.
+     */
+    void cancel();
+    
+    /**
+     * @return whether the scope's been cancelled
+     */
+    bool cancelled() const { return is_cancelled; }
+    
+    /**
+     * @return the reactor the scope belongs to
+     */
+    reactor& loop() const { return owner; }
+private:
+    void schedule(Clock_t::time_point when, Clock_t::duration interval,
+                  std::shared_ptr<reactor::task> work);
+    
+    reactor& owner;
+    task_scope* parent;
+    bool is_cancelled;
+    std::set<int> watched;
+    std::set<reactor::timer_id> timers;
+    std::vector<task_scope*> children;
+    std::vector<reactor::task> cleanups;
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_REACTOR_HXX */
@@ -0,0 +1,112 @@
+/*-
+ * Wakeup latency: how long from one side handing something over to the other
+ * side running with it, while the other side is asleep waiting. Compares a
+ * thread parked on an mpsc_queue (how the client's threads used to talk)
+ * against a reactor woken through its eventfd by post(), and a reactor
+ * posting to itself, as a handler does when it leaves work for later.
+ * 
+ * usage: reactor_bench [handoffs] [us between handoffs]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "reactor.h++"
+#include "ring_queue.t++"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+
+static void report(const char* name, std::vector<double>& waits) {
+    std::sort(waits.begin(), waits.end());
+    auto at = [&waits](double p) {
+        return waits[std::min(waits.size() - 1,
+                              static_cast<std::size_t>(waits.size() * p))];
+    };
+    std::cout << std::fixed << std::setprecision(1) << name << ": p50 "
+              << at(0.5) << " us, p99 " << at(0.99) << " us, max "
+              << waits.back() << " us" << std::endl;
+}
+
+static double since(Clock_t::time_point then) {
+    return std::chrono::duration<double, std::micro>(Clock_t::now()
+                                                     - then).count();
+}
+
+int main(int argc, char** argv) {
+    long handoffs = argc > 1 ? std::atol(argv[1]) : 2000;
+    auto spacing = std::chrono::microseconds(argc > 2 ? std::atol(argv[2])
+                                                      : 500);
+    
+    std::cout << handoffs << " handoffs, " << spacing.count()
+              << " us apart" << std::endl;
+    
+    { /* a thread waiting on a queue */
+        mpsc_queue<Clock_t::time_point> queue(64, overflow_policy::block);
+        std::vector<double> waits;
+        waits.reserve(handoffs);
+        
+        std::thread consumer([&] {
+            std::vector<Clock_t::time_point> got;
+            while (static_cast<long>(waits.size()) < handoffs) {
+                queue.wait_drain(std::back_inserter(got), 64);
+                for (Clock_t::time_point sent : got) {
+                    waits.push_back(since(sent));
+                }
+                got.clear();
+            }
+        });
+        for (long i = 0; i < handoffs; ++i) {
+            std::this_thread::sleep_for(spacing);
+            queue.push(Clock_t::now());
+        }
+        consumer.join();
+        report("mpsc_queue to a waiting thread", waits);
+    }
+    
+    { /* a reactor waiting in epoll_wait() */
+        reactor loop;
+        std::vector<double> waits;
+        waits.reserve(handoffs);
+        
+        std::thread producer([&] {
+            for (long i = 0; i < handoffs; ++i) {
+                std::this_thread::sleep_for(spacing);
+                Clock_t::time_point sent = Clock_t::now();
+                loop.post([&waits, sent] { waits.push_back(since(sent)); });
+            }
+            loop.stop();
+        });
+        loop.run();
+        producer.join();
+        report("reactor::post from another thread", waits);
+    }
+    
+    { /* a reactor handler leaving itself more to do */
+        reactor loop;
+        task_scope scope(loop);
+        std::vector<double> waits;
+        waits.reserve(handoffs);
+        
+        scope.every(spacing, [&] {
+            Clock_t::time_point sent = Clock_t::now();
+            loop.post([&waits, sent] { waits.push_back(since(sent)); });
+            if (static_cast<long>(waits.size()) + 1 >= handoffs) {
+                loop.stop();
+            }
+        });
+        loop.run();
+        report("reactor::post from the loop", waits);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*-
+ * Load generator for basilio_server: connects a crowd of synthetic clients,
+ * has some of them talk at a fixed total rate, and measures how long each
+ * message takes to reach every member of the room.
+ * 
+ * usage: server_load [host] [port] [clients] [senders] [rate] [time] [length]
+ * 
+ *   host     the server (127.0.0.1)
+ *   port     its port (5555)
+ *   clients  how many clients connect (300)
+ *   senders  how many of them talk (10, no more than clients)
+ *   rate     messages a second, between all the senders (200)
+ *   time     seconds to keep talking (5)
+ *   length   payload bytes per message (64)
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "packet.h++"
+#include "framing.h++"
+#include "transport.h++"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace vanwestco;
+using Clock_t = std::chrono::steady_clock;
+
+struct load_client {
+    int fildes;
+    fd_transport link;
+    frame_reader inbound;
+    frame_writer outbound;
+    unsigned long received = 0;
+    
+    explicit load_client(int fildes)
+    : fildes(fildes), link(fildes), inbound(link), outbound(link) { }
+};
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            Clock_t::now().time_since_epoch()).count();
+}
+
+static int connect_to(const char* host, const char* port) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    addrinfo* found;
+    if (::getaddrinfo(host, port, &hints, &found) != 0) { return -1; }
+    int fildes = ::socket(found->ai_family, found->ai_socktype,
+                          found->ai_protocol);
+    if (fildes >= 0
+            && ::connect(fildes, found->ai_addr, found->ai_addrlen) != 0) {
+        ::close(fildes);
+        fildes = -1;
+    }
+    ::freeaddrinfo(found);
+    if (fildes < 0) { return -1; }
+    
+    int on = 1;
+    ::setsockopt(fildes, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    ::fcntl(fildes, F_SETFL, ::fcntl(fildes, F_GETFL) | O_NONBLOCK);
+    return fildes;
+}
+
+int main(int argc, char** argv) {
+    const char* host = argc > 1 ? argv[1] : "127.0.0.1";
+    const char* port = argc > 2 ? argv[2] : "5555";
+    int client_count = argc > 3 ? std::atoi(argv[3]) : 300;
+    int sender_count = argc > 4 ? std::atoi(argv[4]) : 10;
+    double rate      = argc > 5 ? std::atof(argv[5]) : 200;
+    double seconds   = argc > 6 ? std::atof(argv[6]) : 5;
+    std::size_t payload_length = argc > 7 ? std::atol(argv[7]) : 64;
+    sender_count = std::min(sender_count, client_count);
+    
+    /* connect everyone and join them up */
+    std::vector<std::unique_ptr<load_client>> clients;
+    int poller = ::epoll_create1(0);
+    for (int i = 0; i < client_count; ++i) {
+        int fildes = connect_to(host, port);
+        if (fildes < 0) {
+            std::cerr << "couldn't connect client " << i << ": "
+                      << std::strerror(errno) << std::endl;
+            return 1;
+        }
+        clients.push_back(std::make_unique<load_client>(fildes));
+        
+        epoll_event watch;
+        watch.events = EPOLLIN;
+        watch.data.u32 = static_cast<std::uint32_t>(i);
+        ::epoll_ctl(poller, EPOLL_CTL_ADD, fildes, &watch);
+        
+        std::string name = "load" + std::to_string(i);
+        clients.back()->outbound.write(packet(name.length(), packet_type::join,
+                                              0, name.data()));
+    }
+    
+    std::vector<double> latencies;
+    unsigned long delivered = 0;
+    unsigned long announcements = 0;
+    std::size_t bytes_in = 0;
+    Clock_t::time_point last_delivery;
+    std::vector<epoll_event> events(client_count);
+    
+    /* reads whatever's ready, noting the latency of each message */
+    auto pump = [&](int timeout_ms) {
+        int ready = ::epoll_wait(poller, events.data(), client_count,
+                                 timeout_ms);
+        for (int e = 0; e < ready; ++e) {
+            load_client& c = *clients[events[e].data.u32];
+            try {
+                while (c.inbound.fill() != 0) {
+                    while (std::optional<packet> pack = c.inbound.poll()) {
+                        bytes_in += header_length + pack->get_length();
+                        std::string_view text(pack->get_payload(),
+                                              pack->get_length());
+                        std::size_t stamp = text.find(": @");
+                        if (stamp == std::string_view::npos) {
+                            ++announcements;
+                            continue;
+                        }
+                        long long sent = std::atoll(&text[stamp + 3]);
+                        latencies.push_back((now_ns() - sent) / 1e3);
+                        ++delivered;
+                        ++c.received;
+                        last_delivery = Clock_t::now();
+                    }
+                }
+            } catch (transport::exception& exc) {
+                std::cerr << "client " << events[e].data.u32 << ": "
+                          << exc.what() << std::endl;
+                std::exit(1);
+            }
+        }
+    };
+    
+    /* client i hears everyone from i on join */
+    unsigned long joins = static_cast<unsigned long>(client_count)
+                        * (client_count + 1) / 2;
+    Clock_t::time_point give_up = Clock_t::now() + std::chrono::seconds(10);
+    while (announcements < joins && Clock_t::now() < give_up) { pump(100); }
+    std::cout << client_count << " clients joined ("
+              << announcements << '/' << joins << " announcements seen); "
+              << sender_count << " talking at " << rate << " messages/s for "
+              << seconds << " s, " << payload_length << "-byte messages"
+              << std::endl;
+    
+    /* talk */
+    unsigned long sent = 0;
+    Clock_t::time_point start = Clock_t::now();
+    Clock_t::time_point finish = start + std::chrono::duration_cast<
+            Clock_t::duration>(std::chrono::duration<double>(seconds));
+    auto interval = std::chrono::duration_cast<Clock_t::duration>(
+            std::chrono::duration<double>(1 / rate));
+    Clock_t::time_point next_send = start;
+    std::string text;
+    while (Clock_t::now() < finish) {
+        while (Clock_t::now() >= next_send) {
+            text = "@" + std::to_string(now_ns()) + " ";
+            if (text.length() < payload_length) {
+                text.resize(payload_length, 'x');
+            }
+            load_client& speaker = *clients[sent % sender_count];
+            speaker.outbound.write(packet(text.length(),
+                                          packet_type::plaintext, 0,
+                                          text.data()));
+            ++sent;
+            next_send += interval;
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_send - Clock_t::now()).count();
+        pump(static_cast<int>(std::max<long long>(0, wait)));
+    }
+    
+    /* let the stragglers in */
+    unsigned long expected = sent * client_count;
+    give_up = Clock_t::now() + std::chrono::seconds(5);
+    while (delivered < expected && Clock_t::now() < give_up) { pump(100); }
+    
+    for (auto& c : clients) { ::close(c->fildes); }
+    ::close(poller);
+    
+    double elapsed = std::chrono::duration<double>(last_delivery
+                                                   - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        if (latencies.empty()) { return 0.0; }
+        return latencies[std::min(latencies.size() - 1,
+                                  static_cast<std::size_t>(
+                                          latencies.size() * p))];
+    };
+    unsigned long fewest = sent;
+    for (auto& c : clients) { fewest = std::min(fewest, c->received); }
+    
+    std::cout << std::fixed << std::setprecision(0)
+              << sent << " messages sent, " << delivered << '/' << expected
+              << " deliveries (" << expected - delivered << " missing, "
+              << "slowest client got " << fewest << ")" << std::endl
+              << delivered / elapsed << " deliveries/s, "
+              << std::setprecision(1)
+              << bytes_in / elapsed / (1024 * 1024) << " MiB/s fanned out"
+              << std::endl
+              << "delivery latency: p50 " << percentile(0.5) << " us, p99 "
+              << percentile(0.99) << " us, p99.9 " << percentile(0.999)
+              << " us, max " << (latencies.empty() ? 0 : latencies.back())
+              << " us" << std::endl;
+    
+    return delivered == expected ? 0 : 2;
+}
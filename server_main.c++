@@ -0,0 +1,108 @@
+/*-
+ * Driver for basilio_server.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "basilio_server.h++"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <argp.h>
+#include <signal.h>
+
+struct arguments_object {
+    std::string port;
+    std::size_t send_limit = vanwestco::basilio_server::default_send_limit;
+    bool debug_mode_on = false;
+} arguments;
+
+namespace constants {
+static constexpr int key_debug = static_cast<int>('d');
+static constexpr int key_queue = static_cast<int>('q');
+} /* ~namespace constants */
+
+const char* argp_program_version = "basilio_server 0.0";
+const char* argp_program_bug_address = "nowhere@bananaland.gov";
+
+static const char* doc = "Somewhere for basilio_chat to connect to.";
+static const char* args_doc = "port";
+
+static const struct argp_option options[] = {
+    { "debug", constants::key_debug, nullptr, 0,
+            "Log connections and disconnections." },
+    { "queue", constants::key_queue, "KIB", 0,
+            "Let at most this much wait to go out to each client." },
+    { nullptr }
+};
+
+static error_t parse_function(int key, char* arg, argp_state* state) {
+    struct arguments_object* arguments =
+            static_cast<arguments_object*>(state->input);
+    
+    switch (key) {
+    case constants::key_debug:
+        arguments->debug_mode_on = true;
+        break;
+    case constants::key_queue:
+        arguments->send_limit = std::strtoul(arg, nullptr, 10) * 1024;
+        if (arguments->send_limit == 0) { argp_usage(state); }
+        break;
+    case ARGP_KEY_NO_ARGS:
+        argp_usage(state);
+        break;
+    case ARGP_KEY_ARG:
+        if (state->arg_num > 0) {
+            argp_usage(state);
+        }
+        arguments->port = arg;
+        break;
+    default:
+        return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+static const struct argp parser = { options, parse_function, args_doc, doc };
+
+using namespace vanwestco;
+
+static basilio_server* running_server = nullptr;
+
+static void handle_stop_signal(int) {
+    if (running_server != nullptr) { running_server->stop(); }
+}
+
+int main(int argc, char** argv) {
+    error_t err = argp_parse(&parser, argc, argv, ARGP_NO_EXIT,
+                             nullptr, static_cast<void*>(&arguments));
+    if (err != 0 || arguments.port.length() == 0) { return err; }
+    
+    try {
+        basilio_server server(arguments.port,
+                              arguments.send_limit,
+                              arguments.debug_mode_on);
+        running_server = &server;
+        ::signal(SIGINT, handle_stop_signal);
+        ::signal(SIGTERM, handle_stop_signal);
+        
+        server.main();
+        
+        const basilio_server::statistics& counts = server.counters();
+        std::cerr << counts.connections << " connections, "
+                  << counts.packets_in << " packets in, "
+                  << counts.frames_out << " frames out in "
+                  << counts.writes << " writes, "
+                  << counts.dropped << " voice frames dropped, "
+                  << counts.kicked << " slow clients cut off" << std::endl;
+        running_server = nullptr;
+    } catch (basilio_server::exception& ex) {
+        std::cerr << argv[0] << ": " << ex.what() << std::endl;
+        return 3;
+    }
+    
+    return 0;
+}
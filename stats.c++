@@ -0,0 +1,72 @@
+#include "stats.h++"
+
+#include <sstream>
+
+using histogram = vanwestco::histogram;
+
+void histogram::record(std::uint64_t value) {
+    buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    
+    std::uint64_t seen = maximum.load(std::memory_order_relaxed);
+    while (value > seen
+           && !maximum.compare_exchange_weak(seen, value,
+                                             std::memory_order_relaxed)) { }
+}
+
+double histogram::mean() const {
+    std::uint64_t n = count();
+    return n == 0 ? 0 : static_cast<double>(sum.load(std::memory_order_relaxed))
+                        / n;
+}
+
+std::uint64_t histogram::percentile(double fraction) const {
+    std::uint64_t n = count();
+    if (n == 0) { return 0; }
+    
+    std::uint64_t wanted = static_cast<std::uint64_t>(fraction * n);
+    if (wanted >= n) { wanted = n - 1; }
+    
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > wanted) {
+            std::uint64_t middle = bucket_middle(i);
+            return middle < max() ? middle : max();
+        }
+    }
+    return max(); /* recorded while we were counting */
+}
+
+std::string histogram::summary(const char* unit) const {
+    std::ostringstream out;
+    out << "n=" << count()
+        << " mean=" << static_cast<std::uint64_t>(mean())
+        << " p50=" << percentile(0.5)
+        << " p99=" << percentile(0.99)
+        << " max=" << max();
+    if (*unit != '\0') { out << ' ' << unit; }
+    return out.str();
+}
+
+/*----------------------------------------------------------------------------*/
+
+std::size_t histogram::bucket_of(std::uint64_t value) {
+    /* values small enough to have no lower bits to spare get a bucket each */
+    if (value < sub_buckets) { return static_cast<std::size_t>(value); }
+    
+    int top = 63 - __builtin_clzll(value); /* index of the highest set bit */
+    std::size_t within = (value >> (top - sub_bucket_bits)) & (sub_buckets - 1);
+    return (top - sub_bucket_bits + 1) * sub_buckets + within;
+}
+
+std::uint64_t histogram::bucket_middle(std::size_t bucket) {
+    if (bucket < sub_buckets) { return bucket; }
+    
+    int top = static_cast<int>(bucket / sub_buckets) + sub_bucket_bits - 1;
+    std::uint64_t within = bucket % sub_buckets;
+    std::uint64_t low = (std::uint64_t(1) << top)
+                      | (within << (top - sub_bucket_bits));
+    return low + (std::uint64_t(1) << (top - sub_bucket_bits)) / 2;
+}
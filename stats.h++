@@ -0,0 +1,113 @@
+/**
+ * Cheap always-on counters and histograms for keeping an eye on the client.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_STATS_HXX
+#define BASILIO_CHAT_STATS_HXX
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vanwestco {
+
+/*----------------------------------------------------------------------------*
+ |                                  counter                                   |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * A count that any thread can bump. Relaxed atomics only, so it costs about
+ * as much as an ordinary increment on an uncontended cache line.
+ * 
+ * @version 0
+ */
+class counter {
+public:
+    void add(std::uint64_t amount = 1) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+    
+    std::uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<std::uint64_t> value{0};
+};
+
+/*----------------------------------------------------------------------------*
+ |                                 histogram                                  |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * A histogram of non-negative values with logarithmic buckets: each power of
+ * two is split into eight, so anything read back is within about 6% of the
+ * truth. Recording is a handful of relaxed atomic operations and never
+ * allocates; any thread may record while another reads.
+ * 
+ * @version 0
+ */
+class histogram {
+public:
+    /**
+     * Adds a value.
+     * 
+     * @param value the value
+     */
+    void record(std::uint64_t value);
+    
+    /**
+     * @return how many values have been recorded
+     */
+    std::uint64_t count() const {
+        return total.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * @return the mean of the recorded values (0 if there aren't any)
+     */
+    double mean() const;
+    
+    /**
+     * @return the biggest value recorded
+     */
+    std::uint64_t max() const {
+        return maximum.load(std::memory_order_relaxed);
+    }
+    
+    /**
+     * Estimates a percentile.
+     * 
+     * @param fraction which one, from 0 to 1 (0.99 for the 99th)
+     * @return roughly the value below which that fraction of values fall
+     */
+    std::uint64_t percentile(double fraction) const;
+    
+    /**
+     * Summarizes the histogram on one line, e.g.
+     * "n=1042 mean=310 p50=288 p99=1210 max=2004 us".
+     * 
+     * @param unit what to put after the numbers
+     * @return the summary
+     */
+    std::string summary(const char* unit = "") const;
+private:
+    static constexpr const int sub_bucket_bits = 3;
+    static constexpr const int sub_buckets = 1 << sub_bucket_bits;
+    static constexpr const std::size_t bucket_count = 64 * sub_buckets;
+    
+    static std::size_t bucket_of(std::uint64_t value);
+    static std::uint64_t bucket_middle(std::size_t bucket);
+    
+    std::atomic<std::uint64_t> buckets[bucket_count] = {};
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> maximum{0};
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_STATS_HXX */
@@ -1,7 +1,15 @@
 #include "terminal_manager.h++"
 
-#include <iostream>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
 #include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 using display = vanwestco::terminal::display;
 
@@ -18,16 +26,37 @@ static constexpr const int input_prompt_length     = 2;
 static constexpr const int more_characters_length  = 1;
 } /* ~namespace termctl */
 
+/* how many updates can pile up before writers have to wait */
+static constexpr const std::size_t display_queue_capacity = 1024;
+
+/* set by SIGWINCH; the display thread (or draw()) picks it up */
+static std::atomic<bool> window_resized(false);
+
+/* the display's eventfd, written by SIGWINCH to wake its owner (or, for a
+   threaded display, its resize thread) */
+static std::atomic<int> resize_wakeup(-1);
+
+static void note_resize(int) {
+    int saved_errno = errno;
+    int wakeup = resize_wakeup.load(std::memory_order_relaxed);
+    if (wakeup >= 0) { /* before the flag, so draw() can't miss the write */
+        std::uint64_t one = 1;
+        ::write(wakeup, &one, sizeof(one));
+    }
+    window_resized.store(true, std::memory_order_relaxed);
+    errno = saved_errno;
+}
+
 display::display_update::display_update(
         const update_type t, const std::string& l, const int c) 
 : type(t), line(l), cursor(c) {
-    
+
 }
 
 display::display_update::display_update(
         const update_type t, const char* l, const int c) 
 : type(t), line(l), cursor(c) {
-    
+
 }
 
 const std::string& display::display_update::get_line() const {
@@ -45,94 +74,204 @@ const int display::display_update::cursor_pos() const {
 
 /*----------------------------------------------------------------------------*/
 
-display::display(const int width) : display_thread([this] { this->loop(); }) {
+display::display(const int width, const int frames_per_second,
+                 const int output, const bool threaded)
+: threaded(threaded), wake_pending(false), output(output),
+  input_changed(true), frames(0), bytes(0), queued(0), drawn(0),
+  updates(display_queue_capacity, vanwestco::overflow_policy::block) {
     terminal_width = width;
     cursor = 0;
     print_offset = 0;
+    frame_interval = frames_per_second > 0
+                   ? std::chrono::duration_cast<
+                             std::chrono::steady_clock::duration>(
+                             std::chrono::seconds(1)) / frames_per_second
+                   : std::chrono::steady_clock::duration::zero();
+    last_frame = std::chrono::steady_clock::now() - frame_interval;
+    
+    /* redraw for the new width when the window changes size */
+    if (isatty(output)) {
+        /* the resize thread blocks on it; an unthreaded owner polls it */
+        resize_wakeup = ::eventfd(0, threaded ? EFD_CLOEXEC
+                                              : EFD_NONBLOCK | EFD_CLOEXEC);
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_handler = note_resize;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGWINCH, &action, nullptr);
+    }
+    
+    /* only start once everything the loop touches is set up */
+    if (threaded) {
+        display_thread = std::thread([this] { this->loop(); });
+        if (resize_wakeup.load() >= 0) {
+            resize_thread = std::thread([this] { this->watch_resizes(); });
+        }
+    }
 }
 
 display::~display() {
-    this->update(display::display_update(
-            display::display_update::update_type::end_of_line, ""));
-    display_thread.join();
+    if (threaded) {
+        if (resize_thread.joinable()) { /* nudge it out of its read() */
+            resizes_stopping = true;
+            std::uint64_t one = 1;
+            ::write(resize_wakeup.load(), &one, sizeof(one));
+            resize_thread.join();
+            ::close(resize_wakeup.exchange(-1));
+        }
+        
+        this->update(display::display_update(
+                display::display_update::update_type::end_of_line, ""));
+        display_thread.join();
+    } else { /* draw what's left, leaving a clean line behind */
+        std::lock_guard l(state_lock);
+        frame.append(termctl::clear_line)
+             .append(termctl::cursor_column_1);
+        emit_frame();
+        
+        int wakeup = resize_wakeup.exchange(-1);
+        if (wakeup >= 0) { ::close(wakeup); }
+    }
+}
+
+void display::watch_resizes() {
+    int wakeup = resize_wakeup.load();
+    std::uint64_t count;
+    while (true) {
+        if (::read(wakeup, &count, sizeof(count)) < 0) {
+            if (errno == EINTR) { continue; }
+            return;
+        }
+        if (resizes_stopping) { return; }
+        
+        /* the handler may not have set it yet; an empty update wakes the
+           display thread to pick up the new width */
+        window_resized.store(true, std::memory_order_relaxed);
+        this->update(display_update(display_update::update_type::no_update,
+                                    ""));
+    }
 }
 
 void display::loop() {
+    using clock = std::chrono::steady_clock;
     bool running = true;
+    std::vector<display_update> batch;
+    batch.reserve(display_queue_capacity);
+    
     sketch_input_line();
+    emit_frame();
+    
+    /* folds everything in the batch into the next frame */
+    std::size_t applied = 0;
+    auto absorb = [&] {
+        for (const display_update& next : batch) {
+            if (!apply(next)) {
+                running = false;
+                break;
+            }
+        }
+        applied += batch.size();
+        batch.clear();
+    };
     
     while (running) {
-        // std::unique_lock<std::mutex> lock(update_sync);
-        // 
-        // /* check to see if anything's there */
-        // if (updates.empty()) {
-        //     update_cv.wait(lock, [this] { return !updates.empty(); });
-        // }
-        // const display_update next = updates.front();
-        /* wait for a display update */
-        const display_update next = updates.wait_front();
+        /* wait for display updates (resizes send an empty one) */
+        updates.wait_drain(std::back_inserter(batch), display_queue_capacity);
+        absorb();
         
-        /* do tasks */
-        switch (next.get_type()) {
-        case display_update::update_type::no_update:
-            break;
-        case display_update::update_type::input_line:
-            /* store the new input line */
-            input_line = next.get_line();
-            
-            [[fallthrough]];
-        case display_update::update_type::cursor_pos:
-            cursor = next.cursor_pos();
-            
-            if (print_offset == 0) { /* starting from bare prompt */
-                /* shift the text window right */
-                if (cursor > terminal_width
-                             - termctl::input_prompt_length
-                             - termctl::more_characters_length) {
-                    print_offset = cursor
-                                   - (terminal_width
-                                      - termctl::input_prompt_length
-                                      - termctl::more_characters_length);
-                }
-            } else {
-                if (cursor < print_offset) {
-                    print_offset = cursor;
-                } else if (cursor - print_offset 
-                           > terminal_width
-                             - 2 * termctl::more_characters_length) {
-                    print_offset = cursor 
-                                   - (terminal_width 
-                                      - 2 * termctl::more_characters_length);
-                }
-            }
-            
-            sketch_input_line();
-            break;
-        case display_update::update_type::new_line:
-            /* write the new line over the input line, line-feeding, 
-               in the bottom left */
-            std::cout << termctl::clear_line
-                      << termctl::cursor_column_1
-                      << next.get_line().c_str()
-                      << std::endl;
+        /* too soon for another frame; keep taking updates (so nobody's kept
+           waiting on a full queue) until it's time */
+        clock::time_point due = last_frame + frame_interval;
+        while (running && (input_changed || !frame.empty())
+               && clock::now() < due) {
+            updates.wait_drain_for(std::back_inserter(batch),
+                                   display_queue_capacity,
+                                   due - clock::now());
+            absorb();
+        }
+        
+        if (window_resized.exchange(false, std::memory_order_relaxed)) {
+            terminal_width = terminal::get_terminal_width(output);
+            input_changed = true;
+        }
+        
+        if (!running) { /* leave a clean line behind */
+            frame.append(termctl::clear_line)
+                 .append(termctl::cursor_column_1);
+        } else if (input_changed || !frame.empty()) {
+            scroll_to_cursor();
             sketch_input_line();
-            break;
-        case display_update::update_type::end_of_line:
-            running = false;
-            std::cout << termctl::clear_line
-                      << termctl::cursor_column_1
-                      << std::flush;
-            break;
         }
         
-        updates.pop();
+        if (!frame.empty()) {
+            emit_frame();
+            last_frame = clock::now();
+        }
+        drawn += applied;
+        applied = 0;
+        drawn_changed.notify();
+    }
+}
+
+bool display::apply(const display_update& next) {
+    switch (next.get_type()) {
+    case display_update::update_type::no_update:
+        break;
+    case display_update::update_type::input_line:
+        /* store the new input line */
+        input_line = next.get_line();
+        
+        [[fallthrough]];
+    case display_update::update_type::cursor_pos:
+        cursor = next.cursor_pos();
+        input_changed = true;
+        break;
+    case display_update::update_type::new_line:
+        /* write the new line over the input line, line-feeding, 
+           in the bottom left */
+        if (frame.empty()) {
+            frame.append(termctl::clear_line)
+                 .append(termctl::cursor_column_1);
+        }
+        frame.append(next.get_line()).push_back('\n');
+        break;
+    case display_update::update_type::bell:
+        frame.push_back('\x07');
+        break;
+    case display_update::update_type::end_of_line:
+        return false;
+    }
+    return true;
+}
+
+void display::scroll_to_cursor() {
+    if (print_offset == 0) { /* starting from bare prompt */
+        /* shift the text window right */
+        if (cursor > terminal_width
+                     - termctl::input_prompt_length
+                     - termctl::more_characters_length) {
+            print_offset = cursor
+                           - (terminal_width
+                              - termctl::input_prompt_length
+                              - termctl::more_characters_length);
+        }
+    } else {
+        if (cursor < print_offset) {
+            print_offset = cursor;
+        } else if (cursor - print_offset 
+                   > terminal_width
+                     - 2 * termctl::more_characters_length) {
+            print_offset = cursor 
+                           - (terminal_width 
+                              - 2 * termctl::more_characters_length);
+        }
     }
 }
 
 void display::sketch_input_line() {
-    int fill_length, left_fill_length; /* number of characters surrounding and
-                                          to the left of the message,
-                                          respectively */
+    int left_fill_length; /* number of characters to the left of the
+                             message */
     
     left_fill_length = print_offset == 0 
                        ? termctl::input_prompt_length
@@ -144,38 +283,114 @@ void display::sketch_input_line() {
                             + 1;               /* terminal text columns are
                                                   indexed from 1 */
     /* prepare screen for write */
-    std::cout << termctl::clear_line
-              << termctl::cursor_column_1;
+    frame.append(termctl::clear_line)
+         .append(termctl::cursor_column_1);
     
     if (print_offset == 0) { /* starting at prompt */
-        std::cout << termctl::input_prompt;
+        frame.append(termctl::input_prompt);
         
-        if (input_line.length() <= terminal_width
-                                   - termctl::input_prompt_length
-                                   - termctl::more_characters_length) {
-            std::cout << input_line;
+        if (static_cast<int>(input_line.length())
+                <= terminal_width - termctl::input_prompt_length
+                   - termctl::more_characters_length) {
+            frame.append(input_line);
         } else {
-            std::cout << input_line.substr(0, terminal_width 
-                                              - termctl::input_prompt_length
-                                              - termctl::more_characters_length)
-                      << termctl::more_characters;
+            frame.append(input_line, 0, terminal_width 
+                                        - termctl::input_prompt_length
+                                        - termctl::more_characters_length)
+                 .append(termctl::more_characters);
         }
     } else { /* starting wherever */
-        std::cout << termctl::more_characters
-                  << input_line.substr(print_offset, 
-                                       terminal_width 
-                                       - 2 * termctl::more_characters_length);
-        if (input_line.length() > terminal_width
-                                  - 2 * termctl::more_characters_length
-                                  + print_offset) {
-            std::cout << termctl::more_characters;
+        frame.append(termctl::more_characters)
+             .append(input_line, print_offset,
+                     terminal_width - 2 * termctl::more_characters_length);
+        if (static_cast<int>(input_line.length())
+                > terminal_width - 2 * termctl::more_characters_length
+                  + print_offset) {
+            frame.append(termctl::more_characters);
+        }
+    }
+    
+    frame.append(termctl::csi_base)
+         .append(std::to_string(screen_cursor_pos))
+         .push_back('G');
+    input_changed = false;
+}
+
+void display::emit_frame() {
+    const char* next = frame.data();
+    std::size_t left = frame.length();
+    while (left > 0) {
+        ssize_t written = ::write(output, next, left);
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            break; /* nowhere to draw; nothing to be done about it */
         }
+        next += written;
+        left -= written;
     }
     
-    std::cout << termctl::csi_base << screen_cursor_pos << 'G'
-              << std::flush;
+    bytes += frame.length() - left;
+    ++frames;
+    frame.clear();
 }
 
 void display::update(display::display_update next) {
-    updates.push(next);
+    if (threaded) {
+        ++queued;
+        updates.push(std::move(next));
+        return;
+    }
+    
+    /* fold it straight into the next frame; there's no queue to fill up */
+    {
+        std::lock_guard l(state_lock);
+        ++queued;
+        apply(next);
+    }
+    if (!wake_pending.exchange(true) && wake) { wake(); }
+}
+
+std::chrono::steady_clock::time_point display::draw() {
+    using clock = std::chrono::steady_clock;
+    std::lock_guard l(state_lock);
+    
+    if (window_resized.exchange(false, std::memory_order_relaxed)) {
+        std::uint64_t count;
+        int wakeup = resize_wakeup.load(std::memory_order_relaxed);
+        if (wakeup >= 0) { ::read(wakeup, &count, sizeof(count)); }
+        terminal_width = terminal::get_terminal_width(output);
+        input_changed = true;
+    }
+    
+    if (input_changed || !frame.empty()) {
+        clock::time_point now = clock::now();
+        if (now < last_frame + frame_interval) {
+            return last_frame + frame_interval;
+        }
+        
+        scroll_to_cursor();
+        sketch_input_line();
+        emit_frame();
+        last_frame = now;
+    }
+    drawn = queued.load();
+    drawn_changed.notify();
+    
+    /* anything applied from here on wasn't drawn, so it has to wake us */
+    wake_pending = false;
+    return clock::time_point::max();
+}
+
+void display::on_update(std::function<void()> wake) {
+    std::lock_guard l(state_lock);
+    this->wake = std::move(wake);
+}
+
+int display::resize_descriptor() const {
+    return threaded ? -1 : resize_wakeup.load();
+}
+
+void display::sync() {
+    unsigned long target = queued.load();
+    drawn_changed.wait([this, target] { return drawn.load() >= target; });
 }
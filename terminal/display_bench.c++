@@ -0,0 +1,97 @@
+/*-
+ * Pushes a flood of new_line updates through the display and reports how
+ * long it took and how much was written, against the old way of drawing
+ * every update on its own. Output goes to /dev/null, so this measures the
+ * program's side of things rather than the terminal's.
+ * 
+ * usage: display_bench [lines]
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#include "terminal_manager.h++"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace vanwestco;
+using display = terminal::display;
+using update_type = display::display_update::update_type;
+
+static void report(const char* name, double seconds, unsigned long bytes,
+                   unsigned long writes) {
+    std::cout << name << ": " << seconds * 1000 << " ms, "
+              << bytes << " bytes in " << writes << " writes" << std::endl;
+}
+
+/**
+ * What display::loop() used to do for each new_line: clear the input line,
+ * write the new line with std::endl, then redraw the input line and flush.
+ */
+static void run_legacy(long lines, const std::string& input) {
+    std::FILE* out = std::fopen("/dev/null", "w");
+    unsigned long bytes = 0, writes = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < lines; ++i) {
+        std::string line = "someone: message number " + std::to_string(i);
+        bytes += std::fprintf(out, "\x1b[2K\x1b[1G%s\n", line.c_str());
+        std::fflush(out);
+        bytes += std::fprintf(out, "\x1b[2K\x1b[1G\x1b[1m>\x1b[0m %s\x1b[%dG",
+                              input.c_str(),
+                              static_cast<int>(input.length()) + 3);
+        std::fflush(out);
+        writes += 2;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    std::fclose(out);
+    
+    report("before (one redraw per update)",
+           std::chrono::duration<double>(elapsed).count(), bytes, writes);
+}
+
+static void run(const char* name, long lines, const std::string& input,
+                int frames_per_second) {
+    int out = ::open("/dev/null", O_WRONLY);
+    unsigned long bytes, frames;
+    
+    auto start = std::chrono::steady_clock::now();
+    {
+        display d(80, frames_per_second, out);
+        d.update(display::display_update(update_type::input_line, input,
+                                         input.length()));
+        for (long i = 0; i < lines; ++i) {
+            d.update(display::display_update(
+                    update_type::new_line,
+                    "someone: message number " + std::to_string(i)));
+        }
+        
+        d.sync();
+        bytes = d.bytes_written();
+        frames = d.frames_drawn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    ::close(out);
+    
+    report(name, std::chrono::duration<double>(elapsed).count(), bytes,
+           frames);
+}
+
+int main(int argc, char** argv) {
+    long lines = argc > 1 ? std::atol(argv[1]) : 100'000;
+    std::string input = "half a thought";
+    
+    std::cout << lines << " new_line updates" << std::endl;
+    run_legacy(lines, input);
+    run("after (coalesced, uncapped)", lines, input, 0);
+    run("after (coalesced, 60 fps)", lines, input, 60);
+    
+    return 0;
+}
@@ -8,35 +8,46 @@ using input_reader = vanwestco::terminal::input_reader;
 using display      = vanwestco::terminal::display;
 using update_type  = vanwestco::terminal::display::display_update::update_type;
 
-input_reader::input_reader(display& d)
-: cursor(0), out(d),
-  command_thread([this] {
-    bool running = true;
-    while (running) {
-        /* wait for a command to be available */
-        char next_key = command_queue.wait_front();
-        
-        if (next_key == '\x00') { /* should stop command operation */
-            running = false;
-        } else {
-            /* get the command */
-            vanwestco::terminal::command* next; {
-                std::lock_guard l(command_access_lock);
-                next = commands.at(next_key);
-            }
-            
-            /* pop it out of the queue */
-            command_queue.pop();
+/* keypresses beyond this many unhandled commands wait their turn */
+static constexpr const std::size_t command_queue_capacity = 64;
+
+/* where feed() is in an escape sequence */
+enum escape_state : int {
+    no_escape     = 0,
+    after_escape  = 1, /* had ESC */
+    after_bracket = 2  /* had ESC [ */
+};
+
+input_reader::input_reader(display& d, bool threaded)
+: cursor(0), escape(no_escape), threaded(threaded), out(d),
+  command_queue(command_queue_capacity, vanwestco::overflow_policy::block) {
+    if (!threaded) { return; } /* commands run in feed() instead */
+    
+    command_thread = std::thread([this] {
+        bool running = true;
+        while (running) {
+            /* wait for a command to be available */
+            char next_key = command_queue.pop();
             
-            /* actually run it */
-            (*next)();
+            if (next_key == '\x00') { /* should stop command operation */
+                running = false;
+            } else {
+                /* get the command */
+                vanwestco::terminal::command* next; {
+                    std::lock_guard l(command_access_lock);
+                    next = commands.at(next_key);
+                }
+                
+                /* actually run it */
+                (*next)();
+            }
         }
-    }
-  }) {
-
+    });
 }
 
 input_reader::~input_reader() {
+    if (!threaded) { return; }
+    
     /* send a stop message to the command thread */
     command_queue.push('\x00');
     
@@ -48,125 +59,140 @@ std::string input_reader::get_line() {
     /* ensure thread exclusion here */
     std::lock_guard<std::mutex> get_line_exclude(get_line_lock);
     
-    bool reading = true;
     std::string next_line;
+    while (!feed(std::cin.get(), next_line)) { }
+    return next_line;
+}
+
+bool input_reader::feed(char next, std::string& next_line) {
+    update_type next_update = update_type::no_update;
+    bool newline = false;
+    bool reading = true;
     
-    while (reading) {
-        update_type next_update = update_type::no_update;
-        char next = std::cin.get();
-        bool newline = false;
-        
+    /* the rest of an escape sequence */
+    if (escape == after_escape) {
+        escape = next == '[' ? after_bracket : no_escape;
+        return false;
+    } else if (escape == after_bracket) {
+        escape = no_escape;
         switch (next) {
-        case '\n': /* new line */
-            newline = true;
+     /* add letter for ANSI escape code here:
+        case 'A': // ... */
+        }
+        return false;
+    }
+    
+    switch (next) {
+    case '\n': /* new line */
+        newline = true;
+        next_update = update_type::input_line;
+        break;
+    case '\x09':
+    case '\x7F': /* backspace/delete keys */
+        if (cursor != 0 && input_line.size() > 0) {
+            /* remove character */
+            input_line.erase(input_line.begin() + --cursor);
             next_update = update_type::input_line;
-            break;
-        case '\x09':
-        case '\x7F': /* backspace/delete keys */
-            if (cursor != 0 && input_line.size() > 0) {
-                /* remove character */
-                input_line.erase(input_line.begin() + --cursor);
-                next_update = update_type::input_line;
-            }
-            break;
-        case 'd' - 96: /* delete */
-            if (cursor != input_line.size() && input_line.size() > 0) {
-                /* remove character */
-                input_line.erase(input_line.begin() + cursor);
-                next_update = update_type::input_line;
-            }
-            break;
-        case '\x1B': /* special controls */
-            if (std::cin.get() == '[') {
-                char key = std::cin.get();
-                switch (key) {
-             /* add letter for ANSI escape code here:
-                case 'A': // ... */
-                }
-            }
-            break;
-        
-        /* line navigation commands: */
-        case 'f' - 96: /* cursor forward */
-            if (cursor < input_line.size()) {
-                ++cursor;
-            }
-            next_update = update_type::cursor_pos;
-            break;
-        case 'b' - 96: /* cursor back */
-            if (cursor > 0) {
-                --cursor;
+        }
+        break;
+    case 'd' - 96: /* delete */
+        if (cursor != static_cast<int>(input_line.size())
+                && input_line.size() > 0) {
+            /* remove character */
+            input_line.erase(input_line.begin() + cursor);
+            next_update = update_type::input_line;
+        }
+        break;
+    case '\x1B': /* special controls */
+        escape = after_escape;
+        break;
+    
+    /* line navigation commands: */
+    case 'f' - 96: /* cursor forward */
+        if (cursor < static_cast<int>(input_line.size())) {
+            ++cursor;
+        }
+        next_update = update_type::cursor_pos;
+        break;
+    case 'b' - 96: /* cursor back */
+        if (cursor > 0) {
+            --cursor;
+        }
+        next_update = update_type::cursor_pos;
+        break;
+    case 'a' - 96: /* beginning of line */
+        cursor = 0;
+        next_update = update_type::cursor_pos;
+        break;
+    case 'e' - 96: /* end of line */
+        cursor = input_line.size();
+        next_update = update_type::cursor_pos;
+        break;
+    default:
+        if ((1 <= next) && (next <= 26)) { /* control character */
+            char control = next + 96;
+            
+            /* check if key is registered */
+            bool registered; {
+                std::lock_guard l(command_access_lock);
+                registered = (commands.find(control) != commands.end());
             }
-            next_update = update_type::cursor_pos;
-            break;
-        case 'a' - 96: /* beginning of line */
-            cursor = 0;
-            next_update = update_type::cursor_pos;
-            break;
-        case 'e' - 96: /* end of line */
-            cursor = input_line.size();
-            next_update = update_type::cursor_pos;
-            break;
-        default:
-            if ((1 <= next) && (next <= 26)) { /* control character */
-                char control = next + 96;
-                
-                /* check if key is registered */
-                bool registered; {
+            
+            if (registered && threaded) { /* queue the key pressed */
+                command_queue.push(control);
+            } else if (registered) { /* or just run its command */
+                vanwestco::terminal::command* command; {
                     std::lock_guard l(command_access_lock);
-                    registered = (commands.find(control) != commands.end());
-                }
-                
-                if (registered) { /* push the key pressed into the queue */
-                    command_queue.push(control);
+                    command = commands.at(control);
                 }
-            } else if (input_line.size() < max_line_length) { /* within range */
-                /* add character */
-                input_line.insert(input_line.begin() + cursor++, next);
-                next_update = update_type::input_line;
+                (*command)();
             }
-            break;
+        } else if (input_line.size() < max_line_length) { /* within range */
+            /* add character */
+            input_line.insert(input_line.begin() + cursor++, next);
+            next_update = update_type::input_line;
+        }
+        break;
+    }
+    
+    /* do display update */
+    switch (next_update) {
+    case update_type::no_update:
+        break;
+    case update_type::input_line: {
+        /* necessary because input_line is stored as std::vector */
+        char nl_int[input_line.size() + 1];
+        std::size_t i = 0;
+        for (; i < input_line.size(); ++i) {
+            nl_int[i] = input_line[i];
         }
+        nl_int[i] = 0; /* null terminator */
         
-        /* do display update */
-        switch (next_update) {
-        case update_type::no_update:
-            break;
-        case update_type::input_line: {
-            /* necessary because input_line is stored as std::vector */
-            char nl_int[input_line.size() + 1];
-            int i = 0;
-            for (; i < input_line.size(); ++i) {
-                nl_int[i] = input_line[i];
-            }
-            nl_int[i] = 0; /* null terminator */
-            
-            if (newline) {
-                /* send new input line off  */
-                next_line = std::string(nl_int);
-                cursor = 0;
-                input_line.clear();
-                reading = false;
-                
-                /* clear the old input line */
-                nl_int[0] = 0;
-            }
+        if (newline) {
+            /* send new input line off  */
+            next_line = std::string(nl_int);
+            cursor = 0;
+            input_line.clear();
+            reading = false;
             
-            out.update(display::display_update(update_type::input_line,
-                                               nl_int, cursor));
-            break;
+            /* clear the old input line */
+            nl_int[0] = 0;
         }
         
-        case update_type::cursor_pos:
-            out.update(display::display_update(update_type::cursor_pos,
-                                               "", cursor));
-            break;
-        default:
-            break;
-        }
+        out.update(display::display_update(update_type::input_line,
+                                           nl_int, cursor));
+        break;
     }
     
-    return next_line;
+    case update_type::cursor_pos:
+        out.update(display::display_update(update_type::cursor_pos,
+                                           "", cursor));
+        break;
+    default:
+        break;
+    }
+    
+    return !reading;
 }
 
 void input_reader::register_command(char key,
@@ -4,12 +4,16 @@
 
 using terminal = vanwestco::terminal;
 
-terminal::terminal() 
-: t_settings(), t_original(), out(terminal::get_terminal_width()), in(out) {
+terminal::terminal(const int frames_per_second, const int output,
+                   const bool threaded) 
+: t_settings(), t_original(),
+  out(terminal::get_terminal_width(output), frames_per_second, output,
+      threaded),
+  in(out, threaded) {
     /* get current terminal's attributes */
     tcgetattr(0, &t_settings);
     tcgetattr(0, &t_original);
-
+    
     t_settings.c_lflag &= ~(ECHO|ECHOE|ECHOK|ECHONL|ICANON);
     t_settings.c_cc[VMIN] = 1;
     t_settings.c_cc[VTIME] = 0;
@@ -41,6 +45,11 @@ void terminal::write_err(const char* line) {
     write_line(std::string(line));
 }
 
+void terminal::ring_bell() {
+    out.update(display::display_update(
+            display::display_update::update_type::bell, ""));
+}
+
 std::string terminal::read_line() {
     return in.get_line();
 }
@@ -53,6 +62,8 @@ void terminal::register_command(char key, terminal::command* cmd) {
 
 int terminal::get_terminal_width(int fildes) {
     struct winsize window;
-    ioctl(fildes, TIOCGWINSZ, &window);
+    if (ioctl(fildes, TIOCGWINSZ, &window) != 0 || window.ws_col == 0) {
+        return 80;
+    }
     return window.ws_col;
 }
@@ -9,11 +9,17 @@
 #ifndef BASILIO_CHAT_TERMINAL_HXX
 #define BASILIO_CHAT_TERMINAL_HXX
 
-#include "../sync_queue.t++"
+#include "../ring_queue.t++"
 
+#include <atomic>
+#include <functional>
 #include <string>
 #include <thread>
+#include <chrono>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+#include <mutex>
 #include <termios.h>
 
 namespace vanwestco {
@@ -35,7 +41,14 @@ public:
     /**
      * Manages the task of displaying characters on the terminal.
      * 
-     * @version 0
+     * Updates are applied in batches: the display thread takes everything
+     * that's queued, keeps only the latest input line and cursor position,
+     * and draws the result as one frame built in memory and sent with a
+     * single write(). Frames are drawn at most frames_per_second times a
+     * second; updates arriving in between are folded into the next frame.
+     * The display also redraws for the new width when the window is resized.
+     * 
+     * @version 1
      */
     class display {
     public:
@@ -60,6 +73,7 @@ public:
              * new_line:    add a new line of dialogue above the input line
              * input_line:  update the input line characters
              * cursor_pos:  update the cursor position
+             * bell:        ring the terminal bell
              * end_of_line: program's about to exit
              * 
              * @version 0
@@ -69,6 +83,7 @@ public:
                 new_line,
                 input_line, 
                 cursor_pos,
+                bell,
                 end_of_line
             };
             
@@ -128,16 +143,29 @@ public:
          |                        display functions                    |
          *-------------------------------------------------------------*/
         
+        /**
+         * Default cap on frames drawn per second.
+         */
+        constexpr const static int default_frame_rate = 60;
+        
         /**
          * Constructs a display object for a terminal of the given width.
          * 
          * @param width width of the terminal in characters
+         * @param frames_per_second the most frames to draw a second (0 for
+         *                          no limit)
+         * @param output the file descriptor to draw on
+         * @param threaded whether to draw from a thread of its own; if not,
+         *                 whoever owns the display calls draw()
          */
-        display(const int width = 80);
+        display(const int width = 80,
+                const int frames_per_second = default_frame_rate,
+                const int output = 1,
+                const bool threaded = true);
         
         /**
          * Destroys the current display. Will not return until the display
-         * thread shuts down.
+         * thread shuts down; an unthreaded display draws whatever's left.
          */
         ~display();
         
@@ -147,6 +175,52 @@ public:
          * @param next the update
          */
         void update(display_update next);
+        
+        /**
+         * Waits until every update queued so far has been drawn.
+         */
+        void sync();
+        
+        /**
+         * For an unthreaded display: draws everything updated so far, if the
+         * frame rate allows.
+         * 
+         * @return when to call again, if the frame rate held something back
+         *         (time_point::max() if not); until then, updates won't wake
+         *         the owner again
+         */
+        std::chrono::steady_clock::time_point draw();
+        
+        /**
+         * For an unthreaded display: sets what to call when an update comes
+         * in and the display has nothing waiting to be drawn, so the owner
+         * knows to call draw(). It may be called from any thread that calls
+         * update().
+         * 
+         * @param wake what to call
+         */
+        void on_update(std::function<void()> wake);
+        
+        /**
+         * For an unthreaded display: a descriptor that turns readable when
+         * the window changes size, for the owner to watch alongside whatever
+         * else it waits on and call draw() when it does. draw() picks up the
+         * new width and makes it unreadable again.
+         * 
+         * @return the descriptor, or -1 if the output isn't a terminal or the
+         *         display is threaded
+         */
+        int resize_descriptor() const;
+        
+        /**
+         * @return the number of frames drawn so far
+         */
+        unsigned long frames_drawn() const { return frames.load(); }
+        
+        /**
+         * @return the number of bytes written to the terminal so far
+         */
+        unsigned long bytes_written() const { return bytes.load(); }
     private:
         /**
          * Runs the main display update loop.
@@ -155,17 +229,58 @@ public:
         void loop();
         
         /**
-         * Updates the text input line, using whatever parameters are
-         * currently set.
+         * For a threaded display: waits on the resize eventfd and wakes the
+         * display thread whenever the window changes size.
+         */
+        void watch_resizes();
+        
+        /**
+         * Folds an update into the state for the next frame.
+         * 
+         * @param next the update
+         * @return false if it was end_of_line
+         */
+        bool apply(const display_update& next);
+        
+        /**
+         * Moves the visible part of the input line so the cursor's in it.
+         */
+        void scroll_to_cursor();
+        
+        /**
+         * Appends the text input line, drawn using whatever parameters are
+         * currently set, to the frame.
          */
         void sketch_input_line();
         
+        /**
+         * Writes out the frame and empties it.
+         */
+        void emit_frame();
+        
         std::thread display_thread;
+        std::thread resize_thread;
+        std::atomic<bool> resizes_stopping{false};
+        bool threaded;
+        std::mutex state_lock;          /* unthreaded: guards what's below */
+        std::function<void()> wake;
+        std::atomic<bool> wake_pending; /* wake() called, draw() not yet */
+        std::chrono::steady_clock::time_point last_frame;
         int terminal_width;
         int print_offset;
         std::string input_line;
         int cursor;
-        sync_queue<display_update> updates;
+        
+        int output;
+        std::chrono::steady_clock::duration frame_interval;
+        std::string frame;        /* what the next write() will send */
+        bool input_changed;       /* input line needs redrawing */
+        std::atomic<unsigned long> frames;
+        std::atomic<unsigned long> bytes;
+        std::atomic<unsigned long> queued;  /* updates ever queued */
+        std::atomic<unsigned long> drawn;   /* updates ever drawn */
+        impl_::parking_spot drawn_changed;  /* sync() waits on it */
+        mpsc_queue<display_update> updates; /* anyone may write lines */
     };
     
     /*-----------------------------------------------------------------*
@@ -210,8 +325,10 @@ public:
          * characters appear).
          * 
          * @param d the display
+         * @param threaded whether commands run on a thread of their own (if
+         *                 not, they run inside feed())
          */
-        input_reader(display& d);
+        input_reader(display& d, bool threaded = true);
         
         /**
          * (only necessary to stop the command dispatch thread)
@@ -226,6 +343,16 @@ public:
          */
         std::string get_line();
         
+        /**
+         * Takes one typed character, as get_line() does with each it reads,
+         * for when something else is doing the reading.
+         * 
+         * @param typed the character
+         * @param line where to put the line, if this finished one
+         * @return whether it finished a line
+         */
+        bool feed(char typed, std::string& line);
+        
         /**
          * Registers a command to a given key.
          *  
@@ -236,6 +363,8 @@ public:
         constexpr const static int max_line_length = 1023;
         std::vector<char> input_line;
         int cursor; /* basically an offset in input_line */
+        int escape; /* how far into an escape sequence we are */
+        bool threaded;
         display& out;
         std::mutex get_line_lock; /* for get_line() thread safety */
         
@@ -243,7 +372,7 @@ public:
         std::unordered_map<char, terminal::command*> commands;
         
         /* stuff for async command callbacks */
-        sync_queue<char> command_queue;
+        spsc_queue<char> command_queue; /* only get_line() pushes */
         std::thread command_thread;
     };
     
@@ -255,8 +384,16 @@ public:
      * Constructs a terminal object and sets up the terminal for manual
      * control.
      * 
+     * @param frames_per_second the most times a second to redraw (0 for no
+     *                          limit)
+     * @param output the file descriptor to draw on
+     * @param threaded whether the display and commands get threads of their
+     *                 own; if not, the owner passes input to feed() and calls
+     *                 draw()
      */
-    terminal();
+    terminal(const int frames_per_second = display::default_frame_rate,
+             const int output = 1,
+             const bool threaded = true);
     
     /**
      * Destroys the terminal object, returning the terminal to its previous
@@ -292,6 +429,11 @@ public:
      */
     void write_err(const char* line);
     
+    /**
+     * Rings the terminal bell, along with the next frame.
+     */
+    void ring_bell();
+    
     /**
      * Reads a line from the terminal.
      * 
@@ -299,6 +441,37 @@ public:
      */
     std::string read_line();
     
+    /**
+     * For an unthreaded terminal: takes one typed character.
+     * 
+     * @see input_reader::feed()
+     */
+    bool feed(char typed, std::string& line) { return in.feed(typed, line); }
+    
+    /**
+     * For an unthreaded terminal: draws what's changed.
+     * 
+     * @see display::draw()
+     */
+    std::chrono::steady_clock::time_point draw() { return out.draw(); }
+    
+    /**
+     * For an unthreaded terminal: says what to call when there's something
+     * to draw.
+     * 
+     * @see display::on_update()
+     */
+    void on_update(std::function<void()> wake) {
+        out.on_update(std::move(wake));
+    }
+    
+    /**
+     * For an unthreaded terminal: what to watch for window resizes.
+     * 
+     * @see display::resize_descriptor()
+     */
+    int resize_descriptor() const { return out.resize_descriptor(); }
+    
     /**
      * Registers a command for a given Control-[key] action. For example,
      * calling register_command('h', &go_on_hold) would cause go_on_hold->() to
@@ -308,22 +481,32 @@ public:
      * @param cmd the command to run
      */
     void register_command(char key, command* cmd);
+    
+    /**
+     * @return how many frames the display has drawn
+     */
+    unsigned long frames_drawn() const { return out.frames_drawn(); }
+    
+    /**
+     * @return how many bytes the display has written
+     */
+    unsigned long bytes_written() const { return out.bytes_written(); }
 private:
     /**
-     * Finds and reports the current width of the terminal. Only called once,
-     * during initialization, so don't get your hopes up for auto-resizing.
+     * Finds and reports the current width of the terminal. The display calls
+     * this again whenever the window's resized.
      * 
      * @param fildes the file descriptor of the terminal
      * 
-     * @return the terminal width in characters
+     * @return the terminal width in characters (80 if it can't tell)
      */
     static int get_terminal_width(int fildes = 0);
     
     struct termios t_settings;
     struct termios t_original;
     
+    display out;      /* before in, which keeps a reference to it */
     input_reader in;
-    display out;
 };
 
 } /* ~namespace vanwestco */
@@ -0,0 +1,133 @@
+#include "transport.h++"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <limits.h>
+
+using fd_transport = vanwestco::fd_transport;
+
+std::size_t fd_transport::read_some(char* into, std::size_t length) {
+    while (true) {
+        ssize_t got = ::read(fildes, into, length);
+        if (got > 0) {
+            return static_cast<std::size_t>(got);
+        } else if (got == 0) {
+            throw end_of_stream("EOF on packet stream");
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (errno != EINTR) {
+            throw exception(std::string("read failed: ")
+                            += std::strerror(errno));
+        }
+    }
+}
+
+void fd_transport::write_all(const iovec* parts, int count) {
+    /* writev() may stop anywhere, so work on a copy we can advance */
+    iovec pending[IOV_MAX];
+    
+    while (count > 0) {
+        int batch = count < IOV_MAX ? count : IOV_MAX;
+        for (int i = 0; i < batch; ++i) { pending[i] = parts[i]; }
+        
+        iovec* next = pending;
+        int left = batch;
+        while (left > 0) {
+            ssize_t sent = ::writev(fildes, next, left);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    pollfd wait = { fildes, POLLOUT, 0 };
+                    ::poll(&wait, 1, -1);
+                    continue;
+                } else if (errno == EINTR) {
+                    continue;
+                }
+                throw exception(std::string("write failed: ")
+                                += std::strerror(errno));
+            }
+            
+            /* skip past whatever made it out */
+            std::size_t done = static_cast<std::size_t>(sent);
+            while (left > 0 && done >= next->iov_len) {
+                done -= next->iov_len;
+                ++next;
+                --left;
+            }
+            if (left > 0) {
+                next->iov_base = static_cast<char*>(next->iov_base) + done;
+                next->iov_len -= done;
+            }
+        }
+        
+        parts += batch;
+        count -= batch;
+    }
+}
+
+std::size_t fd_transport::write_some(const iovec* parts, int count) {
+    while (true) {
+        ssize_t sent = ::writev(fildes, parts, count < IOV_MAX ? count
+                                                               : IOV_MAX);
+        if (sent >= 0) {
+            return static_cast<std::size_t>(sent);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (errno != EINTR) {
+            throw exception(std::string("write failed: ")
+                            += std::strerror(errno));
+        }
+    }
+}
+
+void fd_transport::shutdown() {
+    ::shutdown(fildes, SHUT_RDWR);
+}
+
+int fd_transport::connect(const std::string& host, const std::string& port) {
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    
+    addrinfo* found;
+    int error = ::getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+    if (error != 0) {
+        throw exception(std::string("couldn't look up ") + host + ": "
+                        + ::gai_strerror(error));
+    }
+    
+    /* take the first address that'll have us */
+    int fildes = -1;
+    int reason = 0;
+    for (addrinfo* next = found; next != nullptr && fildes < 0;
+         next = next->ai_next) {
+        fildes = ::socket(next->ai_family, next->ai_socktype,
+                          next->ai_protocol);
+        if (fildes >= 0
+                && ::connect(fildes, next->ai_addr, next->ai_addrlen) != 0) {
+            reason = errno;
+            ::close(fildes);
+            fildes = -1;
+        } else if (fildes < 0) {
+            reason = errno;
+        }
+    }
+    ::freeaddrinfo(found);
+    if (fildes < 0) {
+        throw exception(std::string("couldn't connect to ") + host + ": "
+                        + std::strerror(reason));
+    }
+    
+    /* packets are small and latency matters more than throughput */
+    int on = 1;
+    ::setsockopt(fildes, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fildes;
+}
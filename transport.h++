@@ -0,0 +1,148 @@
+/**
+ * Byte transports for the packet framing layer. A transport only has to know
+ * how to read whatever's available and how to write a gathered list of
+ * buffers; frame_reader and frame_writer (framing.h++) do the rest.
+ * 
+ * @author Charles Van West
+ * @version 0
+ */
+
+#ifndef BASILIO_CHAT_TRANSPORT_HXX
+#define BASILIO_CHAT_TRANSPORT_HXX
+
+#include <cstddef>
+#include <exception>
+#include <string>
+
+#include <sys/uio.h>
+
+namespace vanwestco {
+
+/*----------------------------------------------------------------------------*
+ |                                 transport                                  |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * Base class for something packets can be read from and written to.
+ * 
+ * @version 0
+ */
+class transport {
+public:
+    /**
+     * Thrown when the transport fails.
+     */
+    class exception : public std::exception {
+    public:
+        exception(const std::string& ms) : message(ms) { }
+        const char* what() const noexcept override { return message.c_str(); }
+    private:
+        std::string message;
+    };
+    
+    /**
+     * Thrown when the other end has closed the stream.
+     */
+    class end_of_stream : public exception {
+    public:
+        using exception::exception;
+    };
+    
+    /**
+     * Reads up to length bytes, however many are available, blocking only if
+     * the transport itself blocks.
+     * 
+     * @param into where to put the bytes
+     * @param length the most bytes to read
+     * @return the number of bytes read, or 0 if a non-blocking transport has
+     *         nothing ready
+     * 
+     * @throws end_of_stream if the other end closed the stream
+     * @throws exception (or something transport-specific) on failure
+     */
+    virtual std::size_t read_some(char* into, std::size_t length) = 0;
+    
+    /**
+     * Writes every byte of every part, in order, before returning.
+     * 
+     * @param parts the buffers to write
+     * @param count the number of buffers
+     * 
+     * @throws exception (or something transport-specific) on failure
+     */
+    virtual void write_all(const iovec* parts, int count) = 0;
+    
+    /**
+     * Writes as much of the parts, in order, as the transport takes right
+     * away, blocking only if the transport itself blocks.
+     * 
+     * @param parts the buffers to write
+     * @param count the number of buffers
+     * @return the number of bytes written, or 0 if a non-blocking transport
+     *         has no room
+     * 
+     * @throws exception (or something transport-specific) on failure
+     */
+    virtual std::size_t write_some(const iovec* parts, int count) = 0;
+    
+    /**
+     * Closes the stream in both directions, waking any reader blocked in
+     * read_some() with end_of_stream. Safe to call from any thread.
+     */
+    virtual void shutdown() = 0;
+    
+    virtual ~transport() = default;
+};
+
+/*----------------------------------------------------------------------------*
+ |                                fd_transport                                |
+ *----------------------------------------------------------------------------*/
+
+/**
+ * A transport over a plain POSIX file descriptor (a socket, a socketpair end,
+ * a pipe...). Writes go out with writev(), so a header and its payload leave
+ * in one system call without being copied together first.
+ * 
+ * Does not own the descriptor.
+ * 
+ * @version 0
+ */
+class fd_transport : public transport {
+public:
+    /**
+     * @param fildes the descriptor to use
+     */
+    explicit fd_transport(int fildes) : fildes(fildes) { }
+    
+    std::size_t read_some(char* into, std::size_t length) override;
+    void write_all(const iovec* parts, int count) override;
+    std::size_t write_some(const iovec* parts, int count) override;
+    
+    /**
+     * Shuts the descriptor down with ::shutdown() (so it has to be a socket
+     * to do anything); the descriptor itself stays open.
+     */
+    void shutdown() override;
+    
+    /**
+     * @return the underlying file descriptor
+     */
+    int descriptor() const { return fildes; }
+    
+    /**
+     * Opens a TCP connection, blocking until it's made.
+     * 
+     * @param host the host name or address
+     * @param port the port (or service name)
+     * @return the connected socket, for the caller to close
+     * 
+     * @throws exception if the host can't be found or won't connect
+     */
+    static int connect(const std::string& host, const std::string& port);
+private:
+    int fildes;
+};
+
+} /* ~namespace vanwestco */
+
+#endif /* ~BASILIO_CHAT_TRANSPORT_HXX */